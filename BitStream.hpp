@@ -0,0 +1,154 @@
+#pragma once
+
+/*
+ * Helpers for compact (bit-packed) message encoding:
+ *  - BitWriter / BitReader pack values into exactly as many bits as they need
+ *  - Quantizer maps floats in a known range onto fixed-point integers
+ *
+ * For example:
+ *
+ *   constexpr Quantizer AngleQ{ 0.0f, 6.2831853f, 12 }; //12-bit angles
+ *
+ *   std::vector< uint8_t > bytes;
+ *   BitWriter writer(&bytes);
+ *   writer.write_bool(true);
+ *   writer.write_varint(300);
+ *   AngleQ.write(writer, 1.5f);
+ *   writer.flush(); //pad to a whole byte
+ *
+ *   BitReader reader(bytes.data(), bytes.size());
+ *   bool b = reader.read_bool();
+ *   uint32_t v = reader.read_varint();
+ *   float a = AngleQ.read(reader); //within AngleQ.max_error() of 1.5f
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+//appends bits (least significant first) to a byte vector:
+struct BitWriter {
+	BitWriter(std::vector< uint8_t > *out_) : out(*out_) { assert(out_); }
+
+	//write the low 'bits' bits of value:
+	void write_bits(uint32_t value, uint32_t bits) {
+		assert(bits <= 32);
+		assert(bits == 32 || value < (uint64_t(1) << bits));
+		scratch |= uint64_t(value) << scratch_bits;
+		scratch_bits += bits;
+		while (scratch_bits >= 8) {
+			out.emplace_back(uint8_t(scratch));
+			scratch >>= 8;
+			scratch_bits -= 8;
+		}
+	}
+
+	void write_bool(bool value) {
+		write_bits(value ? 1 : 0, 1);
+	}
+
+	//variable-length unsigned integer: 7 bits at a time, low bits first, each group followed by a 'more' bit:
+	// (values < 128 take 8 bits, < 16384 take 16 bits, ...)
+	void write_varint(uint32_t value) {
+		while (value >= 0x80) {
+			write_bits((value & 0x7f) | 0x80, 8);
+			value >>= 7;
+		}
+		write_bits(value, 8);
+	}
+
+	//pad with zero bits to a whole number of bytes:
+	// (call once after writing everything)
+	void flush() {
+		if (scratch_bits > 0) {
+			out.emplace_back(uint8_t(scratch));
+			scratch = 0;
+			scratch_bits = 0;
+		}
+	}
+
+	std::vector< uint8_t > &out;
+	uint64_t scratch = 0; //bits not yet written to 'out'
+	uint32_t scratch_bits = 0;
+};
+
+//reads bits written by BitWriter; throws if reading past the end of the data:
+struct BitReader {
+	BitReader(uint8_t const *data_, size_t size_) : data(data_), size(size_) { }
+
+	uint32_t read_bits(uint32_t bits) {
+		assert(bits <= 32);
+		if (at + bits > size * 8) {
+			throw std::runtime_error("Ran out of bits reading message.");
+		}
+		uint64_t value = 0;
+		uint32_t got = 0;
+		while (got < bits) {
+			uint32_t ofs = uint32_t(at % 8);
+			uint32_t take = std::min(8 - ofs, bits - got);
+			value |= uint64_t((data[at / 8] >> ofs) & ((1u << take) - 1)) << got;
+			got += take;
+			at += take;
+		}
+		return uint32_t(value);
+	}
+
+	bool read_bool() {
+		return read_bits(1) != 0;
+	}
+
+	uint32_t read_varint() {
+		uint32_t value = 0;
+		for (uint32_t shift = 0; shift < 35; shift += 7) {
+			uint32_t group = read_bits(8);
+			value |= (group & 0x7f) << shift;
+			if (!(group & 0x80)) return value;
+		}
+		throw std::runtime_error("Varint too long reading message.");
+	}
+
+	//were all the bytes used? (ignoring the padding bits in the last byte)
+	bool at_end() const {
+		return (at + 7) / 8 == size;
+	}
+
+	uint8_t const *data;
+	size_t size; //in bytes
+	size_t at = 0; //in bits
+};
+
+//maps floats in [min,max] onto 'bits'-bit integers (values outside the range are clamped):
+struct Quantizer {
+	float min;
+	float max;
+	uint32_t bits;
+
+	constexpr uint32_t steps() const { return (bits >= 32 ? 0xffffffffu : (1u << bits) - 1u); }
+	constexpr float step() const { return (max - min) / float(steps()); }
+	//largest difference between a value in [min,max] and its quantized-then-restored version:
+	// (half a step, plus a little slack for float rounding in dequantize)
+	constexpr float max_error() const { return 0.5f * step() + 4.0f * 1.1920929e-7f * std::max(-min, max); }
+
+	//is 'value' in [min,max]? (values outside are clamped by quantize)
+	constexpr bool contains(float value) const { return value >= min && value <= max; }
+
+	uint32_t quantize(float value) const {
+		if (!(value == value)) value = min; //NaN
+		float t = (std::min(std::max(value, min), max) - min) / (max - min);
+		return uint32_t(std::lround(double(t) * double(steps())));
+	}
+	float dequantize(uint32_t q) const {
+		return min + (max - min) * float(double(q) / double(steps()));
+	}
+
+	void write(BitWriter &writer, float value) const {
+		writer.write_bits(quantize(value), bits);
+	}
+	float read(BitReader &reader) const {
+		return dequantize(reader.read_bits(bits));
+	}
+};
@@ -24,12 +24,19 @@ typedef int ssize_t;
 #include <netinet/ip.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <sys/uio.h>
 
 #define closesocket close
 
 #endif
 
 #include "Connection.hpp"
+#include "Datagram.hpp"
+
+#ifdef CONNECTION_USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 //------------------------------------------------------
 
@@ -38,6 +45,7 @@ typedef int ssize_t;
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <limits>
 
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
@@ -45,21 +53,281 @@ typedef int ssize_t;
 //Also, some help and examples for getaddrinfo from: https://beej.us/guide/bgnet/html/multi/syscalls.html
 
 
+Connection::Connection() {
+}
+
+Connection::~Connection() {
+}
+
+void Connection::send_unreliable(void const *header, size_t header_size, std::shared_ptr< std::vector< uint8_t > const > const &body) {
+	if (!datagram) {
+		send_raw(header, header_size);
+		send_shared(body);
+		return;
+	}
+	DatagramLink::Outgoing message;
+	message.header.assign(reinterpret_cast< uint8_t const * >(header), reinterpret_cast< uint8_t const * >(header) + header_size);
+	message.body = body;
+	datagram->unreliable_queue.emplace_back(std::move(message));
+}
+
+void Connection::take_pending_sends(ByteQueue *to) {
+	assert(to);
+	for (auto const &shared : shared_sends) {
+		size_t before = (shared.at > send_buffer.consumed ? size_t(shared.at - send_buffer.consumed) : 0);
+		if (before > 0) {
+			to->append(send_buffer.data(), before);
+			send_buffer.consume(before);
+		}
+		to->append(shared.data->data() + shared.offset, shared.data->size() - shared.offset);
+	}
+	shared_sends.clear();
+	if (!send_buffer.empty()) {
+		to->append(send_buffer.data(), send_buffer.size());
+		send_buffer.clear();
+	}
+}
+
 void Connection::close() {
+	if (datagram) {
+		//the socket belongs to the Server/Client's DatagramEndpoint, so just tell the peer:
+		datagram_disconnect(*this);
+		socket = InvalidSocket;
+		return;
+	}
 	if (socket != InvalidSocket) {
+		#ifdef CONNECTION_USE_EPOLL
+		if (epoll_fd != -1) {
+			//n.b. closing the socket would also remove it, but only if no other descriptor refers to it:
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+			epoll_fd = -1;
+		}
+		#endif
 		::closesocket(socket);
 		socket = InvalidSocket;
 	}
 }
 
 //---------------------------------
-//Polling helper used by both server and client:
-void poll_connections(
+//Send helper used by both polling versions:
+// sends as much of send_buffer + shared_sends as the socket will take in one call, using scatter/gather I/O.
+// Returns the result of the underlying send call and removes the sent bytes from the queues.
+// ('queued' is set to the number of bytes that were waiting to be sent)
+static ssize_t send_queued(Socket socket, ByteQueue &send_buffer, std::deque< Connection::SharedSend > &shared_sends, int flags, size_t *queued_) {
+	assert(queued_);
+	auto &queued = *queued_;
+
+	struct Part {
+		uint8_t const *data;
+		size_t size;
+	};
+	constexpr size_t MaxParts = 64;
+	Part parts[MaxParts];
+	size_t part_count = 0;
+
+	queued = send_buffer.size();
+	{ //gather pieces in stream order:
+		size_t owned = 0; //bytes of send_buffer already gathered
+		bool all_shared = true;
+		for (auto const &shared : shared_sends) {
+			queued += shared.data->size() - shared.offset;
+			if (part_count + 2 > MaxParts) {
+				all_shared = false;
+				continue;
+			}
+			size_t before = (shared.at > send_buffer.consumed ? size_t(shared.at - send_buffer.consumed) : 0);
+			if (before > owned) {
+				parts[part_count++] = Part{ send_buffer.data() + owned, before - owned };
+				owned = before;
+			}
+			parts[part_count++] = Part{ shared.data->data() + shared.offset, shared.data->size() - shared.offset };
+		}
+		//anything after the last shared buffer:
+		if (all_shared && owned < send_buffer.size()) {
+			parts[part_count++] = Part{ send_buffer.data() + owned, send_buffer.size() - owned };
+		}
+	}
+
+	if (part_count == 0) return 0;
+
+	#ifdef _WIN32
+	WSABUF bufs[MaxParts];
+	for (size_t i = 0; i < part_count; ++i) {
+		bufs[i].buf = reinterpret_cast< char * >(const_cast< uint8_t * >(parts[i].data));
+		bufs[i].len = ULONG(parts[i].size);
+	}
+	DWORD sent = 0;
+	ssize_t ret;
+	if (WSASend(socket, bufs, DWORD(part_count), &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+		errno = (WSAGetLastError() == WSAEWOULDBLOCK ? EWOULDBLOCK : EIO);
+		ret = -1;
+	} else {
+		ret = ssize_t(sent);
+	}
+	(void)flags; //socket is already non-blocking
+	#else
+	struct iovec iov[MaxParts];
+	for (size_t i = 0; i < part_count; ++i) {
+		iov[i].iov_base = const_cast< uint8_t * >(parts[i].data);
+		iov[i].iov_len = parts[i].size;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = part_count;
+	ssize_t ret = sendmsg(socket, &msg, flags);
+	#endif
+
+	if (ret <= 0 || ret > (ssize_t)queued) return ret;
+
+	//remove sent bytes, again in stream order:
+	size_t left = size_t(ret);
+	while (left > 0) {
+		if (shared_sends.empty()) {
+			send_buffer.consume(left);
+			break;
+		}
+		auto &shared = shared_sends.front();
+		size_t before = (shared.at > send_buffer.consumed ? size_t(shared.at - send_buffer.consumed) : 0);
+		if (before > 0) {
+			size_t amt = std::min(left, before);
+			send_buffer.consume(amt);
+			left -= amt;
+		} else {
+			size_t amt = std::min(left, shared.data->size() - shared.offset);
+			shared.offset += amt;
+			left -= amt;
+			if (shared.offset == shared.data->size()) shared_sends.pop_front();
+		}
+	}
+
+	return ret;
+}
+
+//is there data for the socket? (with the network simulator, only what its outgoing link has delivered)
+static bool socket_pending(Connection const &c) {
+	if (c.netsim_send) return !c.netsim_wire.empty();
+	return c.send_pending();
+}
+
+//send_queued() for whichever queue feeds the socket:
+static ssize_t send_socket(Connection &c, int flags, size_t *queued) {
+	if (c.netsim_send) {
+		static thread_local std::deque< Connection::SharedSend > no_shared_sends;
+		return send_queued(c.socket, c.netsim_wire, no_shared_sends, flags, queued);
+	}
+	return send_queued(c.socket, c.send_buffer, c.shared_sends, flags, queued);
+}
+
+//---------------------------------
+//Network simulator helper used by both polling versions (TCP connections only; see Datagram.cpp for UDP):
+// moves queued sends into each connection's outgoing link and delivers whatever both links have released.
+// Returns how long (seconds) until the next data is due to be released.
+static double simulate_connections(
+	std::list< Connection > &connections,
+	NetSim::Settings const &netsim,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	auto now = NetSim::Clock::now();
+	auto next = NetSim::Clock::time_point::max();
+	static thread_local std::vector< uint8_t > data;
+	static thread_local ByteQueue pending;
+
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || c.datagram) continue;
+		if (!c.netsim_send) {
+			c.netsim_send = std::make_unique< NetSim >(netsim, false);
+			c.netsim_recv = std::make_unique< NetSim >(netsim, false);
+		}
+
+		if (c.send_pending()) {
+			c.take_pending_sends(&pending);
+			c.netsim_send->push(pending.data(), pending.size(), now);
+			pending.clear();
+		}
+		while (c.netsim_send->pop(now, &data)) {
+			c.netsim_wire.append(data.data(), data.size());
+			c.mark_sending();
+		}
+
+		bool received = false;
+		while (c.netsim_recv->pop(now, &data)) {
+			c.recv_buffer.append(data.data(), data.size());
+			received = true;
+		}
+		if (received && on_event) on_event(&c, Connection::OnRecv);
+
+		next = std::min({ next, c.netsim_send->next_release(), c.netsim_recv->next_release() });
+	}
+
+	if (next == NetSim::Clock::time_point::max()) return std::numeric_limits< double >::infinity();
+	return std::max(0.0, std::chrono::duration< double >(next - now).count());
+}
+
+//received data goes straight to recv_buffer, or (with the network simulator) into the incoming link:
+// (returns true if recv_buffer changed)
+static bool received_data(Connection &c, char const *data, size_t size) {
+	if (c.netsim_recv) {
+		c.netsim_recv->push(data, size, NetSim::Clock::now());
+		return false;
+	}
+	c.recv_buffer.append(data, size);
+	return true;
+}
+
+//---------------------------------
+//Wakeup socket (see Server::wake): a loopback UDP socket connected to itself,
+// so any thread can make it readable by sending it a byte (works with select, poll, and epoll alike):
+
+static Socket make_wake_socket() {
+	Socket s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == InvalidSocket) {
+		throw std::system_error(errno, std::system_category(), "failed to create wakeup socket");
+	}
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0; //(any free port)
+	socklen_t address_size = sizeof(address);
+	bool ok = bind(s, reinterpret_cast< struct sockaddr * >(&address), sizeof(address)) == 0
+	       && getsockname(s, reinterpret_cast< struct sockaddr * >(&address), &address_size) == 0
+	       && connect(s, reinterpret_cast< struct sockaddr * >(&address), sizeof(address)) == 0;
+	#ifdef _WIN32
+	unsigned long one = 1;
+	ok = ok && ioctlsocket(s, FIONBIO, &one) == 0;
+	#else
+	int flags = fcntl(s, F_GETFL, 0);
+	ok = ok && flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+	#endif
+	if (!ok) {
+		int error = errno;
+		::closesocket(s);
+		throw std::system_error(error, std::system_category(), "failed to set up wakeup socket");
+	}
+	return s;
+}
+
+//read (and ignore) every pending wakeup:
+static void drain_wake_socket(Socket s) {
+	char buffer[64];
+	while (recv(s, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) { }
+}
+
+//---------------------------------
+//Polling helper used by both server and client (select() version, used where epoll isn't available):
+[[maybe_unused]] static void poll_connections(
 	char const *where,
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
 	double timeout,
-	Socket listen_socket = InvalidSocket) {
+	NetSim::Settings const &netsim,
+	Socket listen_socket = InvalidSocket,
+	Socket wake_socket = InvalidSocket) {
+
+	if (netsim.enabled()) {
+		timeout = std::min(timeout, simulate_connections(connections, netsim, on_event));
+	}
 
 	fd_set read_fds, write_fds;
 	FD_ZERO(&read_fds);
@@ -67,18 +335,20 @@ void poll_connections(
 
 	int max = 0;
 
-	//add listen_socket to fd_set if needed:
-	if (listen_socket != InvalidSocket) {
-		max = std::max(max, int(listen_socket));
-		FD_SET(listen_socket, &read_fds);
+	//add listen_socket and wake_socket to fd_set if needed:
+	for (Socket s : { listen_socket, wake_socket }) {
+		if (s != InvalidSocket) {
+			max = std::max(max, int(s));
+			FD_SET(s, &read_fds);
+		}
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != InvalidSocket) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
-			if (!c.send_buffer.empty()) {
+			if (socket_pending(c)) {
 				FD_SET(c.socket, &write_fds);
 			}
 		}
@@ -145,8 +415,7 @@ void poll_connections(
 				if (on_event) on_event(&c, Connection::OnClose);
 				break;
 			} else { //ret > 0
-				c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-				if (on_event) on_event(&c, Connection::OnRecv);
+				if (received_data(c, buffer, ret) && on_event) on_event(&c, Connection::OnRecv);
 				if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
 			}
 		}
@@ -155,36 +424,205 @@ void poll_connections(
 	//process responses:
 	for (auto &c : connections) {
 		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
+		if (c.socket == InvalidSocket || !socket_pending(c) || !FD_ISSET(c.socket, &write_fds)) continue;
+
+		size_t queued = 0;
+		ssize_t ret = send_socket(c, MSG_DONTWAIT, &queued);
 		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
 			//~no problem~, but don't keep trying
 			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
+		} else if (ret <= 0 || ret > (ssize_t)queued) {
 			if (ret < 0) {
 				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+			} else { assert(ret == 0 || ret > (ssize_t)queued);
+				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << queued << "], disconnecting." << std::endl;
 			}
 			c.close();
 			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
 		}
+		//otherwise, ret seems reasonable (and send_queued already removed the sent bytes)
 	}
 
 		
 }
 
+#ifdef CONNECTION_USE_EPOLL
+//---------------------------------
+//epoll helpers:
+
+//create the epoll set used by a Server or Client:
+static int create_epoll(char const *where) {
+	int fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fd < 0) {
+		throw std::system_error(errno, std::system_category(), std::string(where) + ": failed to create epoll set");
+	}
+	return fd;
+}
+
+//marks the wakeup socket's events (the listen socket's are marked with nullptr, and connections' with the Connection):
+static char wake_marker;
+
+//register a connection with an epoll set; edge-triggered, so events only fire on state changes:
+static void register_connection(int epoll_fd, Connection *c, std::vector< Connection * > *sending) {
+	struct epoll_event evt;
+	memset(&evt, 0, sizeof(evt));
+	evt.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	evt.data.ptr = c;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->socket, &evt) != 0) {
+		throw std::system_error(errno, std::system_category(), "failed to add socket to epoll set");
+	}
+	c->epoll_fd = epoll_fd;
+	c->sending = sending;
+	c->writable = true;
+	//anything queued before registration still needs to go out:
+	if (c->send_pending()) c->mark_sending();
+}
+
+//Polling helper used by both server and client (epoll version):
+// cost is proportional to the number of sockets with events plus the number with queued data.
+static void poll_connections(
+	char const *where,
+	int epoll_fd,
+	std::list< Connection > &connections,
+	std::vector< Connection * > &sending,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	NetSim::Settings const &netsim,
+	Socket listen_socket = InvalidSocket) {
+
+	//(the simulator has to visit every connection, since its links release data on their own schedule)
+	if (netsim.enabled()) {
+		timeout = std::min(timeout, simulate_connections(connections, netsim, on_event));
+	}
+
+	//if some connection can send right now, don't wait around for other events:
+	int timeout_ms = std::max(0, int(std::lround(timeout * 1000.0)));
+	for (Connection *c : sending) {
+		if (c->writable && c->socket != InvalidSocket) {
+			timeout_ms = 0;
+			break;
+		}
+	}
+
+	constexpr int MaxEvents = 256;
+	struct epoll_event events[MaxEvents];
+	int count = epoll_wait(epoll_fd, events, MaxEvents, timeout_ms);
+	if (count < 0) {
+		if (errno != EINTR) {
+			std::cerr << "[" << where << "] epoll_wait returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+		}
+		count = 0;
+	}
+
+	const uint32_t BufferSize = 20000;
+	static thread_local char *buffer = new char[BufferSize];
+
+	for (int e = 0; e < count; ++e) {
+		if (events[e].data.ptr == &wake_marker) continue; //(drained by Server::poll)
+
+		Connection *c = reinterpret_cast< Connection * >(events[e].data.ptr);
+
+		if (c == nullptr) {
+			//listen socket is readable; edge-triggered, so accept until there is nothing left:
+			assert(listen_socket != InvalidSocket);
+			while (true) {
+				Socket got = accept(listen_socket, NULL, NULL);
+				if (got == InvalidSocket) break; //EAGAIN (or error -- oh well)
+
+				connections.emplace_back();
+				connections.back().socket = got;
+				try {
+					register_connection(epoll_fd, &connections.back(), &sending);
+				} catch (std::exception const &err) {
+					std::cerr << "[" << where << "] " << err.what() << "; dropping client." << std::endl;
+					connections.back().close();
+					continue; //(reaped by caller)
+				}
+				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
+				if (on_event) on_event(&connections.back(), Connection::OnOpen);
+			}
+			continue;
+		}
+
+		if (c->socket == InvalidSocket) continue; //closed by an earlier callback
+
+		if (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			while (true) { //edge-triggered: read until no more data left to read
+				ssize_t ret = recv(c->socket, buffer, BufferSize, MSG_DONTWAIT);
+				if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					//~no problem~ but no data
+					break;
+				} else if (ret < 0 && errno == EINTR) {
+					continue;
+				} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
+					//~problem~ so remove connection
+					if (ret == 0) {
+						std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+					} else if (ret < 0) {
+						std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+					} else {
+						std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+					}
+					c->close();
+					if (on_event) on_event(c, Connection::OnClose);
+					break;
+				} else { //ret > 0
+					if (received_data(*c, buffer, ret) && on_event) on_event(c, Connection::OnRecv);
+					if (c->socket == InvalidSocket) break; //closed by callback
+				}
+			}
+		}
+
+		if (c->socket != InvalidSocket && (events[e].events & EPOLLOUT)) {
+			c->writable = true;
+			if (socket_pending(*c)) c->mark_sending();
+		}
+	}
+
+	//process responses (only for connections with queued data):
+	size_t keep = 0;
+	for (size_t i = 0; i < sending.size(); ++i) {
+		Connection &c = *sending[i];
+		if (c.socket == InvalidSocket || !socket_pending(c)) {
+			c.in_sending = false;
+			continue;
+		}
+		if (c.writable) {
+			size_t queued = 0;
+			ssize_t ret = send_socket(c, MSG_DONTWAIT | MSG_NOSIGNAL, &queued);
+			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				//~no problem~, but wait for EPOLLOUT before trying again
+				c.writable = false;
+			} else if (ret <= 0 || ret > (ssize_t)queued) {
+				if (ret < 0) {
+					std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+				} else { assert(ret == 0 || ret > (ssize_t)queued);
+					std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << queued << "], disconnecting." << std::endl;
+				}
+				c.close();
+				c.in_sending = false;
+				if (on_event) on_event(&c, Connection::OnClose);
+				continue;
+			} else { //ret seems reasonable (and send_queued already removed the sent bytes)
+				//partial send means the socket buffer is full:
+				if (socket_pending(c)) c.writable = false;
+			}
+		}
+		if (!socket_pending(c)) {
+			c.in_sending = false;
+		} else {
+			sending[keep++] = &c;
+		}
+	}
+	//n.b. the loop above also visits any connections queued by callbacks during the loop:
+	sending.resize(keep);
+}
+#endif //CONNECTION_USE_EPOLL
+
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, Transport transport) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -195,6 +633,12 @@ Server::Server(std::string const &port) {
 	}
 	#endif
 
+	if (transport == Transport::UDP) {
+		datagram = datagram_listen(port);
+		wake_socket = make_wake_socket();
+		return;
+	}
+
 	{ //use getaddrinfo to look up how to bind to port:
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
@@ -266,28 +710,102 @@ Server::Server(std::string const &port) {
 	}
 
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		//(with a deep backlog, so bursts of clients connecting at once aren't dropped and left to retry)
+		int ret = ::listen(listen_socket, SOMAXCONN);
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	#ifdef CONNECTION_USE_EPOLL
+	{ //register listen socket with epoll set:
+		//(edge-triggered accept loop needs a non-blocking listen socket)
+		int flags = fcntl(listen_socket, F_GETFL, 0);
+		if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to make listen socket non-blocking");
+		}
+
+		epoll_fd = create_epoll("Server::Server");
+
+		struct epoll_event evt;
+		memset(&evt, 0, sizeof(evt));
+		evt.events = EPOLLIN | EPOLLET;
+		evt.data.ptr = nullptr; //nullptr marks the listen socket
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &evt) != 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to add listen socket to epoll set");
+		}
+	}
+	#endif
+
+	wake_socket = make_wake_socket();
+	#ifdef CONNECTION_USE_EPOLL
+	{ //register wakeup socket with epoll set:
+		struct epoll_event evt;
+		memset(&evt, 0, sizeof(evt));
+		evt.events = EPOLLIN;
+		evt.data.ptr = &wake_marker;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_socket, &evt) != 0) {
+			throw std::system_error(errno, std::system_category(), "failed to add wakeup socket to epoll set");
+		}
+	}
+	#endif
+}
+
+Server::~Server() {
+	//close every connection (removing its socket from the epoll set), then the server's own descriptors:
+	for (auto &c : connections) {
+		if (c.socket != InvalidSocket) c.close();
+	}
+	for (Socket *s : { &listen_socket, &wake_socket }) {
+		if (*s != InvalidSocket) {
+			::closesocket(*s);
+			*s = InvalidSocket;
+		}
+	}
+	#ifdef CONNECTION_USE_EPOLL
+	if (epoll_fd != -1) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	if (datagram) {
+		datagram_poll("Server::poll", *datagram, connections, on_event, timeout, netsim, wake_socket);
+	} else {
+		#ifdef CONNECTION_USE_EPOLL
+		poll_connections("Server::poll", epoll_fd, connections, sending, on_event, timeout, netsim, listen_socket);
+		#else
+		poll_connections("Server::poll", connections, on_event, timeout, netsim, listen_socket, wake_socket);
+		#endif
+	}
+	//(any wakeups have done their job)
+	drain_wake_socket(wake_socket);
 
 	//reap closed clients:
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
 		auto old = connection;
 		++connection;
 		if (old->socket == InvalidSocket) {
+			if (datagram && old->datagram) {
+				auto f = datagram->by_address.find(old->datagram->address);
+				if (f != datagram->by_address.end() && f->second == &*old) datagram->by_address.erase(f);
+			}
 			connections.erase(old);
 		}
 	}
 }
 
-Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+void Server::wake() {
+	char byte = 0;
+	::send(wake_socket, &byte, 1, MSG_DONTWAIT); //(if the socket's buffer is full, the poll is already awake)
+}
+
+Client::Client(std::string const &host, std::string const &port, Transport transport) : connections(1), connection(connections.front()) {
 	#ifdef _WIN32
 	{ //init winsock:
 		WSADATA info;
@@ -297,6 +815,11 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 	}
 	#endif
 
+	if (transport == Transport::UDP) {
+		datagram = datagram_connect(host, port, &connection);
+		return;
+	}
+
 	{ //use getaddrinfo to look up how to bind to host/port:
 		struct addrinfo hints;
 		memset(&hints, 0, sizeof(hints));
@@ -352,10 +875,33 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
+
+	#ifdef CONNECTION_USE_EPOLL
+	epoll_fd = create_epoll("Client::Client");
+	register_connection(epoll_fd, &connection, &sending);
+	#endif
 }
 
+Client::~Client() {
+	//(over UDP, this tells the server, rather than leaving it to time out)
+	if (connection.socket != InvalidSocket) connection.close();
+	#ifdef CONNECTION_USE_EPOLL
+	if (epoll_fd != -1) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
+}
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	if (datagram) {
+		datagram_poll("Client::poll", *datagram, connections, on_event, timeout, netsim);
+		return;
+	}
+	#ifdef CONNECTION_USE_EPOLL
+	poll_connections("Client::poll", epoll_fd, connections, sending, on_event, timeout, netsim, InvalidSocket);
+	#else
+	poll_connections("Client::poll", connections, on_event, timeout, netsim, InvalidSocket);
+	#endif
 }
 
@@ -14,7 +14,7 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
+				std::vector< uint8_t > data(connection->recv_buffer.begin(), connection->recv_buffer.end());
 				connection->recv_buffer.clear();
 				//send to other connections:
 
@@ -60,14 +60,103 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+#include "NetSim.hpp"
+
 #include <vector>
 #include <list>
+#include <deque>
+#include <memory>
 #include <string>
 #include <functional>
 #include <cstdint>
+#include <cassert>
+
+//Byte queue used for connection buffers:
+// appending is amortized O(1), consuming from the front is O(1) (it just advances a read cursor),
+// and the unread bytes are always contiguous, so message parsers can peek at them in place.
+struct ByteQueue {
+	//unread bytes:
+	size_t size() const { return storage.size() - head; }
+	bool empty() const { return head == storage.size(); }
+	uint8_t *data() { return storage.data() + head; }
+	uint8_t const *data() const { return storage.data() + head; }
+	uint8_t &operator[](size_t i) { return storage[head + i]; }
+	uint8_t const &operator[](size_t i) const { return storage[head + i]; }
+
+	//add bytes to the back of the queue:
+	void append(void const *bytes, size_t count) {
+		compact();
+		storage.insert(storage.end(), reinterpret_cast< uint8_t const * >(bytes), reinterpret_cast< uint8_t const * >(bytes) + count);
+	}
+
+	//remove bytes from the front of the queue:
+	void consume(size_t count) {
+		assert(count <= size());
+		head += count;
+		consumed += count;
+		if (head == storage.size()) {
+			storage.clear();
+			head = 0;
+		}
+	}
+
+	void clear() {
+		consume(size());
+	}
+
+	//std::vector-style helpers so that existing message code keeps compiling;
+	// only appending at end() and erasing from begin() are supported:
+	uint8_t *begin() { return data(); }
+	uint8_t *end() { return storage.data() + storage.size(); }
+	uint8_t const *begin() const { return data(); }
+	uint8_t const *end() const { return storage.data() + storage.size(); }
+	template< typename Iter >
+	void insert(uint8_t const *at, Iter first, Iter last) {
+		assert(at == end() && "ByteQueue only supports inserting at the end");
+		compact();
+		storage.insert(storage.end(), first, last);
+	}
+	void erase(uint8_t const *first, uint8_t const *last) {
+		assert(first == begin() && "ByteQueue only supports erasing from the front");
+		consume(size_t(last - first));
+	}
+
+	//internals:
+	std::vector< uint8_t > storage;
+	size_t head = 0; //read cursor: storage[0,head) has already been consumed
+	uint64_t consumed = 0; //total bytes ever consumed (so data()[0] is byte number 'consumed' of the stream)
+
+	//slide unread bytes to the front once the consumed prefix is at least as big as them;
+	// the copy is paid for by the bytes already consumed, so consume + append stay amortized O(1):
+	void compact() {
+		if (head != 0 && head >= size()) {
+			storage.erase(storage.begin(), storage.begin() + head);
+			head = 0;
+		}
+	}
+};
+
+//On linux, Server/Client use an (edge-triggered) epoll set instead of select(),
+// so the cost of a poll depends on the number of active sockets, not connected sockets:
+#if defined(__linux__)
+#define CONNECTION_USE_EPOLL 1
+#endif
+
+//Server and Client can talk over TCP (a reliable byte stream), or over UDP datagrams (see Datagram.hpp),
+// which carry the same reliable stream plus an unreliable channel for messages where only the newest matters:
+enum class Transport : uint8_t {
+	TCP,
+	UDP,
+};
+
+struct DatagramLink; //(per-connection datagram transport state; defined in Datagram.hpp)
+struct DatagramEndpoint; //(datagram socket shared by a Server's or Client's connections)
 
-//Thin wrapper around a (polling-based) TCP socket connection:
+//Thin wrapper around a (polling-based) socket connection:
 struct Connection {
+	Connection();
+	~Connection();
+
 	//Helper that will append any type to the send buffer:
 	template< typename T >
 	void send(T const &t) {
@@ -75,8 +164,30 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		send_buffer.append(data, size);
+		mark_sending();
 	}
+	//Helper that queues a (possibly shared) immutable buffer after everything already in the send buffer:
+	// the bytes are not copied; they are sent straight from 'data' using scatter/gather I/O.
+	// Useful for sending the same message to many connections.
+	void send_shared(std::shared_ptr< std::vector< uint8_t > const > const &data) {
+		if (!data || data->empty()) return;
+		shared_sends.emplace_back(SharedSend{ send_buffer.consumed + send_buffer.size(), data, 0 });
+		mark_sending();
+	}
+
+	//Queue a message on the unreliable channel: 'header' (copied) followed by 'body' (shared).
+	// Over UDP the message is sent as one datagram (or fragments of one) with no retransmission, and may
+	// arrive out of order or not at all; the receiver gets it in unreliable_recv_buffer.
+	// Over TCP this is the same as send_raw(header) + send_shared(body).
+	void send_unreliable(void const *header, size_t header_size, std::shared_ptr< std::vector< uint8_t > const > const &body);
+
+	//is there any data waiting to be sent?
+	bool send_pending() const { return !send_buffer.empty() || !shared_sends.empty(); }
+
+	//move everything queued by send_raw()/send_shared()/send_buffer onto the end of 'to', in stream order:
+	// (for transports that don't write straight from the send queues)
+	void take_pending_sends(ByteQueue *to);
 
 	//Call 'close' to mark a connection for discard:
 	void close();
@@ -85,12 +196,41 @@ struct Connection {
 	explicit operator bool() { return socket != InvalidSocket; }
 
 	//To send data over a connection, append it to send_buffer:
-	std::vector< uint8_t > send_buffer;
+	ByteQueue send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< uint8_t > recv_buffer;
+	// (parsers should consume() complete messages from the front)
+	ByteQueue recv_buffer;
+	//Complete messages that arrived on the unreliable channel (UDP only; always empty over TCP):
+	ByteQueue unreliable_recv_buffer;
 
 	//internals:
-	Socket socket = InvalidSocket;
+	Socket socket = InvalidSocket; //(for UDP, the socket shared with the Server's other connections)
+	std::unique_ptr< DatagramLink > datagram; //(UDP only)
+
+	//(network simulator only) emulated links for data on its way to the socket and on its way to recv_buffer,
+	// and (TCP only) data the outgoing link has delivered that is waiting for the socket:
+	std::unique_ptr< NetSim > netsim_send, netsim_recv;
+	ByteQueue netsim_wire;
+
+	//buffers queued with send_shared(), interleaved with send_buffer by stream position:
+	struct SharedSend {
+		uint64_t at; //goes after byte number 'at' of send_buffer's stream
+		std::shared_ptr< std::vector< uint8_t > const > data;
+		size_t offset; //bytes of data already sent
+	};
+	std::deque< SharedSend > shared_sends;
+
+	//(epoll only) bookkeeping so that poll only visits connections with data to send:
+	std::vector< Connection * > *sending = nullptr; //owner's list of connections with queued data
+	bool in_sending = false; //is this connection already in the 'sending' list?
+	bool writable = true; //false after send() would block; set again on EPOLLOUT
+	int epoll_fd = -1; //epoll set this socket is registered with (removed on close)
+	void mark_sending() {
+		if (sending && !in_sending) {
+			in_sending = true;
+			sending->emplace_back(this);
+		}
+	}
 
 	enum Event {
 		OnOpen,
@@ -100,7 +240,8 @@ struct Connection {
 };
 
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	Server(std::string const &port, Transport transport = Transport::TCP); //pass the port number to listen on, as a string (servname, really)
+	~Server();
 
 	//poll() updates the list of active connections and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -109,13 +250,29 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//make poll() return now (or right away next time, if it isn't waiting); can be called from any thread:
+	// (so other threads can hand off work to the thread that polls without it polling on a short timeout)
+	void wake();
+
 	std::list< Connection > connections;
 	Socket listen_socket = InvalidSocket;
+	Socket wake_socket = InvalidSocket; //(readable after wake(); poll() waits on it too)
+
+	//(epoll only) persistent event set and list of connections with queued data:
+	int epoll_fd = -1;
+	std::vector< Connection * > sending;
+
+	//(UDP only) the socket all connections share:
+	std::unique_ptr< DatagramEndpoint > datagram;
+
+	//network conditions to simulate on every connection (off unless set; see NetSim.hpp):
+	NetSim::Settings netsim;
 };
 
 
 struct Client {
-	Client(std::string const &host, std::string const &port);
+	Client(std::string const &host, std::string const &port, Transport transport = Transport::TCP);
+	~Client();
 
 	//poll() checks the status of the active connection and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -126,4 +283,14 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+
+	//(epoll only) persistent event set and list of connections with queued data:
+	int epoll_fd = -1;
+	std::vector< Connection * > sending;
+
+	//(UDP only) the client's socket:
+	std::unique_ptr< DatagramEndpoint > datagram;
+
+	//network conditions to simulate on the connection (off unless set; see NetSim.hpp):
+	NetSim::Settings netsim;
 };
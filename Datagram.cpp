@@ -0,0 +1,785 @@
+
+//--------- OS-specific socket-related headers ---------
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1 //so we can use strerror()
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#undef APIENTRY
+#include <winsock2.h>
+#include <ws2tcpip.h> //for getaddrinfo
+#undef max
+#undef min
+
+#pragma comment(lib, "Ws2_32.lib") //link against the winsock2 library
+
+typedef int ssize_t;
+typedef int socklen_t;
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#define closesocket close
+
+#endif
+
+#include "Datagram.hpp"
+
+//------------------------------------------------------
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+using Clock = DatagramLink::Clock;
+
+//first bytes of connect/accept packets (so stray traffic on the port is ignored):
+static constexpr uint32_t Magic = 0x544e4853; //"SHNT"
+
+static constexpr uint8_t PacketConnect = 'C';
+static constexpr uint8_t PacketAccept = 'A';
+static constexpr uint8_t PacketData = 'D';
+static constexpr uint8_t PacketDisconnect = 'X';
+
+static constexpr uint8_t ChunkReliable = 'R';
+static constexpr uint8_t ChunkUnreliable = 'U';
+
+static constexpr size_t DataHeaderSize = 1 + 4 + 2 + 2 + 4;
+static constexpr size_t ReliableChunkHeaderSize = 1 + 4 + 2;
+static constexpr size_t UnreliableChunkHeaderSize = 1 + 2 + 1 + 1 + 2;
+
+//unreliable messages are split into fragments that each fill a packet:
+static constexpr size_t FragmentSize = DatagramLink::MaxPacket - DataHeaderSize - UnreliableChunkHeaderSize;
+static constexpr uint32_t MaxFragments = 255;
+
+//how long a client waits for the server to accept before trying the next address:
+static constexpr double ConnectTimeout = 5.0;
+static constexpr double ConnectRetry = 0.1;
+
+//---------------------------------
+//helpers:
+
+static void put_u16(std::vector< uint8_t > &out, uint16_t v) {
+	out.emplace_back(uint8_t(v));
+	out.emplace_back(uint8_t(v >> 8));
+}
+
+static void put_u32(std::vector< uint8_t > &out, uint32_t v) {
+	out.emplace_back(uint8_t(v));
+	out.emplace_back(uint8_t(v >> 8));
+	out.emplace_back(uint8_t(v >> 16));
+	out.emplace_back(uint8_t(v >> 24));
+}
+
+static uint16_t get_u16(uint8_t const *in) {
+	return uint16_t(uint32_t(in[0]) | (uint32_t(in[1]) << 8));
+}
+
+static uint32_t get_u32(uint8_t const *in) {
+	return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+}
+
+static double seconds(Clock::duration d) {
+	return std::chrono::duration< double >(d).count();
+}
+
+//full 64-bit stream offset for the low 32 bits 'low', assuming it is within 2GB of 'near':
+static uint64_t unwrap_offset(uint32_t low, uint64_t near) {
+	return uint64_t(int64_t(near) + int64_t(int32_t(low - uint32_t(near))));
+}
+
+static void make_non_blocking(Socket s) {
+	#ifdef _WIN32
+	unsigned long one = 1;
+	if (ioctlsocket(s, FIONBIO, &one) != 0) {
+		throw std::runtime_error("failed to make datagram socket non-blocking");
+	}
+	#else
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0) {
+		throw std::system_error(errno, std::system_category(), "failed to make datagram socket non-blocking");
+	}
+	#endif
+}
+
+//did the last call fail because nothing was waiting?
+static bool would_block() {
+	#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+	#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+	#endif
+}
+
+//did the last call fail because the peer isn't listening? (ICMP port unreachable; only reported on connected sockets)
+static bool refused() {
+	#ifdef _WIN32
+	return WSAGetLastError() == WSAECONNRESET;
+	#else
+	return errno == ECONNREFUSED;
+	#endif
+}
+
+//send one datagram to 'address' (or to the connected peer if 'address' is empty);
+// failures (e.g., a full socket buffer) are just packet loss, which the protocol already handles:
+static void send_packet(Socket socket, std::string const &address, uint8_t const *data, size_t size) {
+	if (address.empty()) {
+		::send(socket, reinterpret_cast< char const * >(data), int(size), 0);
+	} else {
+		struct sockaddr_storage to;
+		assert(address.size() <= sizeof(to));
+		memcpy(&to, address.data(), address.size());
+		::sendto(socket, reinterpret_cast< char const * >(data), int(size), 0, reinterpret_cast< struct sockaddr const * >(&to), socklen_t(address.size()));
+	}
+}
+
+//printable version of a peer address:
+static std::string describe(std::string const &address) {
+	char host[NI_MAXHOST], serv[NI_MAXSERV];
+	if (0 != getnameinfo(reinterpret_cast< struct sockaddr const * >(address.data()), socklen_t(address.size()), host, sizeof(host), serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV)) {
+		return "[unknown address]";
+	}
+	return std::string(host) + ":" + serv;
+}
+
+//wait up to 'timeout' seconds for 'socket' (or 'also', if valid) to have something to read:
+// (poll() rather than select(), since an fd_set can't hold descriptors past FD_SETSIZE, and loadbot opens thousands)
+static void wait_readable(Socket socket, double timeout, Socket also = InvalidSocket) {
+	if (!(timeout > 0.0)) return;
+	struct pollfd pfds[2];
+	uint32_t count = 0;
+	for (Socket s : { socket, also }) {
+		if (s == InvalidSocket) continue;
+		pfds[count].fd = s;
+		pfds[count].events = POLLIN;
+		pfds[count].revents = 0;
+		count += 1;
+	}
+	//(rounded up to whole milliseconds, so short waits don't turn into spinning)
+	int ms = int(std::ceil(std::min(timeout, 3600.0) * 1000.0));
+#ifdef _WIN32
+	WSAPoll(pfds, count, ms);
+#else
+	::poll(pfds, count, ms);
+#endif
+}
+
+//---------------------------------
+//sending:
+
+static void begin_data_packet(DatagramLink const &link, std::vector< uint8_t > &packet) {
+	packet.clear();
+	packet.emplace_back(PacketData);
+	put_u32(packet, link.token);
+	put_u16(packet, link.next_sequence);
+	put_u16(packet, link.received_any ? uint16_t(link.latest_received + 1) : uint16_t(0));
+	put_u32(packet, uint32_t(link.reliable_received));
+}
+
+static void finish_data_packet(Connection &c, std::vector< uint8_t > const &packet, Clock::time_point now) {
+	DatagramLink &link = *c.datagram;
+	assert(packet.size() <= DatagramLink::MaxPacket);
+	if (c.netsim_send) {
+		c.netsim_send->push(packet.data(), packet.size(), now);
+	} else {
+		send_packet(c.socket, link.address, packet.data(), packet.size());
+	}
+	link.sent_at[link.next_sequence & 0xff] = now;
+	link.next_sequence += 1;
+	link.last_sent = now;
+	link.ack_due = false;
+	link.packets_sent += 1;
+}
+
+//send everything the connection has queued (plus retransmissions, acks, and keepalives as needed):
+static void flush(Connection &c, Clock::time_point now) {
+	DatagramLink &link = *c.datagram;
+
+	//everything queued with send()/send_shared() goes on the end of the reliable stream:
+	c.take_pending_sends(&link.reliable_unacked);
+
+	//nothing acknowledged for a while? go back and resend everything unacknowledged:
+	if (link.reliable_next > link.reliable_acked && seconds(now - link.reliable_timer) > link.retransmit) {
+		link.reliable_next = link.reliable_acked;
+		link.retransmit = std::min(DatagramLink::MaxRetransmit, link.retransmit * 2.0);
+		link.retransmits += 1;
+		link.reliable_segments.clear();
+	}
+
+	static thread_local std::vector< uint8_t > packet;
+	begin_data_packet(link, packet);
+	bool has_chunks = false;
+	auto make_room = [&](size_t needed) {
+		if (DatagramLink::MaxPacket - packet.size() >= needed) return;
+		finish_data_packet(c, packet, now);
+		begin_data_packet(link, packet);
+		has_chunks = false;
+	};
+
+	//unreliable messages first, since they are the freshest:
+	while (!link.unreliable_queue.empty()) {
+		DatagramLink::Outgoing const &message = link.unreliable_queue.front();
+		size_t header_size = message.header.size();
+		size_t size = header_size + (message.body ? message.body->size() : 0);
+		uint32_t fragments = std::max< uint32_t >(1, uint32_t((size + FragmentSize - 1) / FragmentSize));
+		if (fragments > MaxFragments) {
+			//too big to fragment, so it goes on the reliable stream instead:
+			link.reliable_unacked.append(message.header.data(), header_size);
+			if (message.body) link.reliable_unacked.append(message.body->data(), message.body->size());
+			link.unreliable_queue.pop_front();
+			continue;
+		}
+
+		uint16_t id = link.next_message++;
+		for (uint32_t f = 0; f < fragments; ++f) {
+			size_t begin = f * FragmentSize;
+			size_t end = std::min(size, begin + FragmentSize);
+			make_room(UnreliableChunkHeaderSize + (end - begin));
+			packet.emplace_back(ChunkUnreliable);
+			put_u16(packet, id);
+			packet.emplace_back(uint8_t(f));
+			packet.emplace_back(uint8_t(fragments));
+			put_u16(packet, uint16_t(end - begin));
+			//copy the part of header + body in [begin,end):
+			if (begin < header_size) {
+				size_t amt = std::min(end, header_size) - begin;
+				packet.insert(packet.end(), message.header.begin() + begin, message.header.begin() + begin + amt);
+				begin += amt;
+			}
+			if (begin < end) {
+				packet.insert(packet.end(), message.body->begin() + (begin - header_size), message.body->begin() + (end - header_size));
+			}
+			has_chunks = true;
+		}
+		link.unreliable_queue.pop_front();
+	}
+
+	//then as much of the reliable stream as the window allows:
+	uint64_t reliable_end = std::min(link.reliable_acked + link.reliable_unacked.size(), link.reliable_acked + DatagramLink::ReliableWindow);
+	while (link.reliable_next < reliable_end) {
+		make_room(ReliableChunkHeaderSize + 1);
+		size_t length = std::min< uint64_t >(DatagramLink::MaxPacket - packet.size() - ReliableChunkHeaderSize, reliable_end - link.reliable_next);
+		if (link.reliable_next == link.reliable_acked) link.reliable_timer = now;
+		packet.emplace_back(ChunkReliable);
+		put_u32(packet, uint32_t(link.reliable_next));
+		put_u16(packet, uint16_t(length));
+		uint8_t const *bytes = link.reliable_unacked.data() + (link.reliable_next - link.reliable_acked);
+		packet.insert(packet.end(), bytes, bytes + length);
+		link.reliable_next += length;
+		link.reliable_segments.emplace_back(DatagramLink::SentSegment{ link.reliable_next, link.next_sequence });
+		has_chunks = true;
+	}
+
+	if (has_chunks || link.ack_due || seconds(now - link.last_sent) >= DatagramLink::KeepAlive) {
+		finish_data_packet(c, packet, now);
+	}
+}
+
+//---------------------------------
+//receiving:
+
+//returns true if bytes were added to recv_buffer:
+static bool receive_reliable(Connection &c, uint32_t offset_low, uint8_t const *bytes, size_t length) {
+	DatagramLink &link = *c.datagram;
+	uint64_t offset = unwrap_offset(offset_low, link.reliable_received);
+
+	if (offset > link.reliable_received) {
+		//past a gap; hold on to it (within reason) until the gap is filled:
+		if (link.out_of_order_bytes + length > DatagramLink::MaxOutOfOrderBytes) return false;
+		auto ret = link.reliable_out_of_order.emplace(offset, std::vector< uint8_t >(bytes, bytes + length));
+		if (ret.second) link.out_of_order_bytes += length;
+		return false;
+	}
+
+	uint64_t skip = link.reliable_received - offset;
+	if (skip >= length) return false; //(already have all of it)
+	c.recv_buffer.append(bytes + skip, length - skip);
+	link.reliable_received += length - skip;
+
+	//segments held past the gap may continue the stream now:
+	while (!link.reliable_out_of_order.empty() && link.reliable_out_of_order.begin()->first <= link.reliable_received) {
+		auto held = link.reliable_out_of_order.begin();
+		uint64_t end = held->first + held->second.size();
+		if (end > link.reliable_received) {
+			c.recv_buffer.append(held->second.data() + (link.reliable_received - held->first), size_t(end - link.reliable_received));
+			link.reliable_received = end;
+		}
+		link.out_of_order_bytes -= held->second.size();
+		link.reliable_out_of_order.erase(held);
+	}
+	return true;
+}
+
+//returns true if a complete message was added to unreliable_recv_buffer:
+static bool receive_unreliable(Connection &c, uint16_t id, uint8_t index, uint8_t count, uint8_t const *bytes, size_t length) {
+	DatagramLink &link = *c.datagram;
+	if (count == 0 || index >= count) return false;
+
+	if (count == 1) {
+		c.unreliable_recv_buffer.append(bytes, length);
+		return true;
+	}
+
+	auto partial = std::find_if(link.partial_messages.begin(), link.partial_messages.end(), [&](DatagramLink::Partial const &p) {
+		return p.message == id && p.fragments.size() == count;
+	});
+	if (partial == link.partial_messages.end()) {
+		if (link.partial_messages.size() >= DatagramLink::MaxPartialMessages) {
+			link.partial_messages.pop_front();
+			link.unreliable_dropped += 1;
+		}
+		link.partial_messages.emplace_back(DatagramLink::Partial{ id, count, std::vector< std::vector< uint8_t > >(count) });
+		partial = link.partial_messages.end() - 1;
+	}
+
+	std::vector< uint8_t > &fragment = partial->fragments[index];
+	if (!fragment.empty() || length == 0) return false; //(duplicate)
+	fragment.assign(bytes, bytes + length);
+	partial->fragments_left -= 1;
+	if (partial->fragments_left > 0) return false;
+
+	for (auto const &f : partial->fragments) {
+		c.unreliable_recv_buffer.append(f.data(), f.size());
+	}
+	link.partial_messages.erase(partial);
+	return true;
+}
+
+static void receive_data(
+	char const *where,
+	Connection &c,
+	uint8_t const *data, size_t size,
+	Clock::time_point now,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	DatagramLink &link = *c.datagram;
+	if (size < DataHeaderSize) return;
+
+	uint16_t sequence = get_u16(data + 5);
+	uint16_t ack = get_u16(data + 7);
+	uint32_t received = get_u32(data + 9);
+
+	link.packets_received += 1;
+	link.last_received = now;
+	if (!link.received_any || int16_t(sequence - link.latest_received) > 0) {
+		link.latest_received = sequence;
+		link.received_any = true;
+	}
+
+	//round trip time from the newest of our packets the peer has seen:
+	if (ack != 0) {
+		uint16_t acked = uint16_t(ack - 1);
+		uint16_t age = uint16_t(link.next_sequence - acked); //(how many packets ago it was sent)
+		if (age >= 1 && age <= link.sent_at.size() && (!link.acked_any || int16_t(acked - link.latest_acked) > 0)) {
+			double sample = seconds(now - link.sent_at[acked & 0xff]);
+			link.rtt = (link.acked_any ? link.rtt + (sample - link.rtt) * 0.125 : sample);
+			link.latest_acked = acked;
+			link.acked_any = true;
+		}
+	}
+
+	//reliable bytes the peer now has:
+	uint64_t acked_offset = unwrap_offset(received, link.reliable_acked);
+	if (acked_offset > link.reliable_acked && acked_offset - link.reliable_acked <= link.reliable_unacked.size()) {
+		link.reliable_unacked.consume(size_t(acked_offset - link.reliable_acked));
+		link.reliable_acked = acked_offset;
+		if (link.reliable_next < link.reliable_acked) link.reliable_next = link.reliable_acked;
+		link.reliable_timer = now;
+		link.retransmit = std::clamp(2.0 * link.rtt, DatagramLink::MinRetransmit, DatagramLink::MaxRetransmit);
+		while (!link.reliable_segments.empty() && link.reliable_segments.front().end <= link.reliable_acked) {
+			link.reliable_segments.pop_front();
+		}
+	}
+
+	//the peer got later packets but not the oldest unacknowledged bytes? they were (most likely) lost, so go back now:
+	if (link.acked_any && !link.reliable_segments.empty()
+	 && int16_t(link.latest_acked - link.reliable_segments.front().sequence) >= int16_t(DatagramLink::FastRetransmit)) {
+		link.reliable_next = link.reliable_acked;
+		link.reliable_timer = now;
+		link.retransmits += 1;
+		link.reliable_segments.clear();
+	}
+
+	bool delivered = false;
+	size_t at = DataHeaderSize;
+	while (at < size) {
+		if (data[at] == ChunkReliable) {
+			if (at + ReliableChunkHeaderSize > size) break;
+			uint32_t offset = get_u32(data + at + 1);
+			size_t length = get_u16(data + at + 5);
+			at += ReliableChunkHeaderSize;
+			if (at + length > size) break;
+			if (receive_reliable(c, offset, data + at, length)) delivered = true;
+			at += length;
+		} else if (data[at] == ChunkUnreliable) {
+			if (at + UnreliableChunkHeaderSize > size) break;
+			uint16_t id = get_u16(data + at + 1);
+			uint8_t index = data[at + 3];
+			uint8_t count = data[at + 4];
+			size_t length = get_u16(data + at + 5);
+			at += UnreliableChunkHeaderSize;
+			if (at + length > size) break;
+			if (receive_unreliable(c, id, index, count, data + at, length)) delivered = true;
+			at += length;
+		} else {
+			std::cerr << "[" << where << "] ignoring unknown chunk type " << int(data[at]) << "." << std::endl;
+			break;
+		}
+		link.ack_due = true;
+	}
+
+	if (delivered && on_event) on_event(&c, Connection::OnRecv);
+}
+
+//a packet for connection 'c' (with the right token):
+static void handle_connection_packet(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	uint8_t const *data, size_t size,
+	Clock::time_point now) {
+
+	if (size < 5 || get_u32(data + 1) != c.datagram->token) return;
+
+	if (data[0] == PacketData) {
+		receive_data(where, c, data, size, now, on_event);
+	} else if (data[0] == PacketDisconnect) {
+		std::cerr << "[" << where << "] peer disconnected." << std::endl;
+		c.close();
+		if (on_event) on_event(&c, Connection::OnClose);
+	}
+	//(anything else -- e.g., a repeated accept -- is ignored)
+}
+
+static void handle_packet(
+	char const *where,
+	DatagramEndpoint &endpoint,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	uint8_t const *data, size_t size,
+	std::string const &from,
+	Clock::time_point now) {
+
+	if (size == 0) return;
+
+	Connection *c = nullptr;
+	if (endpoint.is_server) {
+		auto f = endpoint.by_address.find(from);
+		if (f != endpoint.by_address.end() && f->second->socket != InvalidSocket) c = f->second;
+
+		if (data[0] == PacketConnect) {
+			if (size < 9 || get_u32(data + 1) != Magic) return;
+			uint32_t nonce = get_u32(data + 5);
+			if (c && c->datagram->nonce != nonce) {
+				//a new client from the same address (e.g., restarted), so the old one is gone:
+				std::cerr << "[" << where << "] client at " << describe(from) << " reconnected, dropping old connection." << std::endl;
+				c->close();
+				if (on_event) on_event(c, Connection::OnClose);
+				c = nullptr;
+			}
+			if (!c) {
+				connections.emplace_back();
+				c = &connections.back();
+				c->socket = endpoint.socket;
+				c->datagram = std::make_unique< DatagramLink >();
+				c->datagram->address = from;
+				c->datagram->nonce = nonce;
+				c->datagram->token = uint32_t(endpoint.mt());
+				c->datagram->last_received = now;
+				c->datagram->last_sent = now;
+				endpoint.by_address[from] = c;
+				std::cerr << "[" << where << "] client connected from " << describe(from) << "." << std::endl; //INFO
+				if (on_event) on_event(c, Connection::OnOpen);
+			}
+			//(re)send the accept, in case an earlier one was lost:
+			std::vector< uint8_t > accept;
+			accept.emplace_back(PacketAccept);
+			put_u32(accept, Magic);
+			put_u32(accept, nonce);
+			put_u32(accept, c->datagram->token);
+			send_packet(endpoint.socket, from, accept.data(), accept.size());
+			return;
+		}
+	} else {
+		assert(!connections.empty());
+		if (connections.front().socket != InvalidSocket) c = &connections.front();
+	}
+
+	if (!c) return;
+	if (c->netsim_recv) {
+		c->netsim_recv->push(data, size, now);
+		return;
+	}
+	handle_connection_packet(where, *c, on_event, data, size, now);
+}
+
+//deliver packets and timeouts for the network simulator (if enabled), and return how long until the next is due:
+static double simulate_connections(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	NetSim::Settings const &netsim) {
+
+	auto now = Clock::now();
+	auto next = Clock::time_point::max();
+	static thread_local std::vector< uint8_t > packet;
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || !c.datagram) continue;
+		if (!c.netsim_send) {
+			c.netsim_send = std::make_unique< NetSim >(netsim, true);
+			c.netsim_recv = std::make_unique< NetSim >(netsim, true);
+		}
+		while (c.socket != InvalidSocket && c.netsim_recv->pop(now, &packet)) {
+			handle_connection_packet(where, c, on_event, packet.data(), packet.size(), now);
+		}
+		while (c.socket != InvalidSocket && c.netsim_send->pop(now, &packet)) {
+			send_packet(c.socket, c.datagram->address, packet.data(), packet.size());
+		}
+		next = std::min({ next, c.netsim_send->next_release(), c.netsim_recv->next_release() });
+	}
+	if (next == Clock::time_point::max()) return DatagramLink::KeepAlive;
+	return std::max(0.0, seconds(next - now));
+}
+
+//---------------------------------
+
+DatagramEndpoint::DatagramEndpoint(Socket socket_, bool is_server_) : socket(socket_), is_server(is_server_), mt(std::random_device()()) {
+}
+
+DatagramEndpoint::~DatagramEndpoint() {
+	if (socket != InvalidSocket) {
+		::closesocket(socket);
+		socket = InvalidSocket;
+	}
+}
+
+std::unique_ptr< DatagramEndpoint > datagram_listen(std::string const &port) {
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res = nullptr;
+	int addrinfo_ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+	if (addrinfo_ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(addrinfo_ret)));
+	}
+
+	Socket got = InvalidSocket;
+	std::cout << "[Server::Server] binding (UDP) to " << port << ":" << std::endl;
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		std::cout << "\ttrying " << describe(std::string(reinterpret_cast< char const * >(info->ai_addr), info->ai_addrlen)) << "... "; std::cout.flush();
+
+		Socket s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == InvalidSocket) {
+			std::cout << "(failed to create socket: " << strerror(errno) << ")" << std::endl;
+			continue;
+		}
+		if (bind(s, info->ai_addr, int(info->ai_addrlen)) < 0) {
+			std::cout << "(failed to bind: " << strerror(errno) << ")" << std::endl;
+			::closesocket(s);
+			continue;
+		}
+		std::cout << "success!" << std::endl;
+		got = s;
+		break;
+	}
+	freeaddrinfo(res);
+
+	if (got == InvalidSocket) {
+		throw std::runtime_error("Failed to bind (UDP) to port " + port);
+	}
+
+	try {
+		make_non_blocking(got);
+	} catch (...) {
+		::closesocket(got);
+		throw;
+	}
+	return std::make_unique< DatagramEndpoint >(got, true);
+}
+
+std::unique_ptr< DatagramEndpoint > datagram_connect(std::string const &host, std::string const &port, Connection *connection) {
+	assert(connection);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	struct addrinfo *res = nullptr;
+	int addrinfo_ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+	if (addrinfo_ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(addrinfo_ret)));
+	}
+
+	uint32_t nonce = std::random_device()();
+
+	std::cout << "[Client::Client] connecting (UDP) to " << host << ":" << port << ":" << std::endl;
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		std::cout << "\ttrying " << describe(std::string(reinterpret_cast< char const * >(info->ai_addr), info->ai_addrlen)) << "... "; std::cout.flush();
+
+		Socket s = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == InvalidSocket) {
+			std::cout << "(failed to create socket: " << strerror(errno) << ")" << std::endl;
+			continue;
+		}
+		//a connected socket only receives from the server (and reports when nothing is listening there):
+		if (connect(s, info->ai_addr, int(info->ai_addrlen)) < 0) {
+			std::cout << "(failed to connect: " << strerror(errno) << ")" << std::endl;
+			::closesocket(s);
+			continue;
+		}
+		make_non_blocking(s);
+
+		std::vector< uint8_t > request;
+		request.emplace_back(PacketConnect);
+		put_u32(request, Magic);
+		put_u32(request, nonce);
+
+		//handshake: repeat the connect until the server accepts it:
+		bool accepted = false;
+		bool gave_up = false;
+		uint32_t token = 0;
+		auto start = Clock::now();
+		while (!accepted && !gave_up && seconds(Clock::now() - start) < ConnectTimeout) {
+			send_packet(s, "", request.data(), request.size());
+			wait_readable(s, ConnectRetry);
+			while (true) {
+				uint8_t reply[64];
+				ssize_t ret = recv(s, reinterpret_cast< char * >(reply), sizeof(reply), 0);
+				if (ret < 0) {
+					if (refused()) {
+						std::cout << "(nothing listening)" << std::endl;
+						gave_up = true;
+					}
+					break;
+				}
+				if (ret >= 13 && reply[0] == PacketAccept && get_u32(reply + 1) == Magic && get_u32(reply + 5) == nonce) {
+					token = get_u32(reply + 9);
+					accepted = true;
+					break;
+				}
+			}
+		}
+		if (!accepted) {
+			if (!gave_up) std::cout << "(no answer)" << std::endl;
+			::closesocket(s);
+			continue;
+		}
+		std::cout << "success!" << std::endl;
+
+		freeaddrinfo(res);
+
+		auto now = Clock::now();
+		connection->socket = s;
+		connection->datagram = std::make_unique< DatagramLink >();
+		connection->datagram->token = token;
+		connection->datagram->nonce = nonce;
+		connection->datagram->last_received = now;
+		connection->datagram->last_sent = now;
+		return std::make_unique< DatagramEndpoint >(s, false);
+	}
+
+	freeaddrinfo(res);
+	throw std::runtime_error("Failed to connect (UDP) to any of the addresses tried for server.");
+}
+
+void datagram_poll(
+	char const *where,
+	DatagramEndpoint &endpoint,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	NetSim::Settings const &netsim,
+	Socket wake_socket) {
+
+	{ //wait for packets, but not past the next retransmission, keepalive, or simulated delivery:
+		double wait = std::max(0.0, timeout);
+		if (netsim.enabled()) wait = std::min(wait, simulate_connections(where, connections, on_event, netsim));
+		auto now = Clock::now();
+		for (auto const &c : connections) {
+			if (c.socket == InvalidSocket || !c.datagram) continue;
+			DatagramLink const &link = *c.datagram;
+			if (c.send_pending() || !link.unreliable_queue.empty() || link.ack_due) {
+				wait = 0.0;
+				break;
+			}
+			if (link.reliable_next > link.reliable_acked) {
+				wait = std::min(wait, link.retransmit - seconds(now - link.reliable_timer));
+			}
+			wait = std::min(wait, DatagramLink::KeepAlive - seconds(now - link.last_sent));
+		}
+		wait_readable(endpoint.socket, std::max(0.0, wait), wake_socket);
+	}
+
+	//receive everything waiting:
+	auto now = Clock::now();
+	while (true) {
+		uint8_t buffer[2048];
+		struct sockaddr_storage from;
+		socklen_t from_size = sizeof(from);
+		memset(&from, 0, sizeof(from));
+		ssize_t ret = recvfrom(endpoint.socket, reinterpret_cast< char * >(buffer), sizeof(buffer), 0, reinterpret_cast< struct sockaddr * >(&from), &from_size);
+		if (ret < 0) {
+			if (would_block()) break;
+			if (!endpoint.is_server && refused()) {
+				//(the server's port has gone away)
+				Connection &c = connections.front();
+				if (c.socket != InvalidSocket) {
+					std::cerr << "[" << where << "] server unreachable, disconnecting." << std::endl;
+					c.close();
+					if (on_event) on_event(&c, Connection::OnClose);
+				}
+				break;
+			}
+			#ifndef _WIN32
+			if (errno == EINTR) continue;
+			#endif
+			std::cerr << "[" << where << "] recvfrom() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+			break;
+		}
+		if (size_t(ret) > DatagramLink::MaxPacket) continue; //(not one of ours)
+		std::string address(reinterpret_cast< char const * >(&from), from_size);
+		handle_packet(where, endpoint, connections, on_event, buffer, size_t(ret), address, now);
+	}
+
+	//time out silent connections, then send:
+	now = Clock::now();
+	for (auto &c : connections) {
+		if (c.socket == InvalidSocket || !c.datagram) continue;
+		if (seconds(now - c.datagram->last_received) > DatagramLink::Timeout) {
+			std::cerr << "[" << where << "] nothing heard for " << DatagramLink::Timeout << " seconds, disconnecting." << std::endl;
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			continue;
+		}
+		flush(c, now);
+	}
+
+	//(so packets the simulator doesn't delay go out now rather than next poll)
+	if (netsim.enabled()) simulate_connections(where, connections, on_event, netsim);
+}
+
+void datagram_disconnect(Connection &c) {
+	assert(c.datagram);
+	if (c.socket == InvalidSocket) return;
+	std::vector< uint8_t > packet;
+	packet.emplace_back(PacketDisconnect);
+	put_u32(packet, c.datagram->token);
+	send_packet(c.socket, c.datagram->address, packet.data(), packet.size());
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+//UDP transport for Server/Client (used when they are created with Transport::UDP).
+//
+// Every connection carries two channels over one UDP socket:
+//  - the reliable, ordered byte stream that Connection::send()/recv_buffer always provide
+//    (split into segments at stream offsets, acknowledged cumulatively, resent go-back-N after a timeout);
+//  - an unreliable channel for Connection::send_unreliable() messages: never resent, so a lost snapshot
+//    doesn't hold up newer ones the way a lost TCP segment does.
+// Messages bigger than one datagram are fragmented (and reassembled, or dropped if a fragment is lost).
+//
+// Packets (little-endian):
+//   connect:    'C' magic:u32 nonce:u32                  (client -> server, repeated until accepted)
+//   accept:     'A' magic:u32 nonce:u32 token:u32        (server -> client)
+//   data:       'D' token:u32 sequence:u16 ack:u16 received:u32 chunk*
+//   disconnect: 'X' token:u32
+// where 'ack' is the latest packet sequence number received, 'received' is how much of the reliable stream
+// has arrived (low 32 bits of the offset), and each chunk is one of:
+//   reliable:   'R' offset:u32 length:u16 bytes
+//   unreliable: 'U' message:u16 fragment:u8 fragments:u8 length:u16 bytes
+// The token (chosen by the server at accept) must match for data from an address to be accepted.
+
+#include "Connection.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DatagramLink {
+	using Clock = std::chrono::steady_clock;
+
+	//biggest datagram sent (fits the 1280-byte IPv6 minimum MTU with room for IP/UDP headers):
+	static constexpr size_t MaxPacket = 1200;
+	//most reliable bytes in flight (sent but not acknowledged):
+	static constexpr uint64_t ReliableWindow = 64 * 1024;
+	//most unreliable messages being reassembled at once (older partial messages are dropped):
+	static constexpr size_t MaxPartialMessages = 8;
+	//most reliable bytes held while waiting for a gap to fill:
+	static constexpr size_t MaxOutOfOrderBytes = 1024 * 1024;
+	//retransmission timeout bounds (seconds):
+	static constexpr double MinRetransmit = 0.05;
+	static constexpr double MaxRetransmit = 1.0;
+	//resend without waiting for the timeout once the peer has packets this much newer than the one with the oldest unacknowledged bytes:
+	static constexpr uint16_t FastRetransmit = 3;
+	//send an (empty) packet after this long without sending, and give up after this long without hearing back:
+	static constexpr double KeepAlive = 1.0;
+	static constexpr double Timeout = 10.0;
+
+	uint32_t token = 0; //identifies the connection in data packets (chosen by the server)
+	uint32_t nonce = 0; //client's connect nonce (so a repeated connect gets the same accept)
+
+	//peer address (for sendto on a server's shared socket; empty for a client's connected socket):
+	std::string address;
+
+	//---- packets ----
+	uint16_t next_sequence = 0;
+	uint16_t latest_received = 0; //newest packet sequence number received from the peer
+	bool received_any = false;
+	uint16_t latest_acked = 0; //newest of our packets the peer has said it received
+	bool acked_any = false;
+	bool ack_due = false; //received something the peer should hear about
+	Clock::time_point last_sent;
+	Clock::time_point last_received;
+
+	//round trip time estimate (from the acks of recent packets):
+	std::array< Clock::time_point, 256 > sent_at; //by sequence number & 0xff
+	double rtt = 0.1; //smoothed (seconds)
+	double retransmit = 0.2; //current retransmission timeout (seconds)
+
+	//---- reliable stream (sending) ----
+	uint64_t reliable_acked = 0; //peer has every byte before this offset
+	uint64_t reliable_next = 0; //offset of the next byte to (re)send
+	ByteQueue reliable_unacked; //bytes [reliable_acked, reliable_acked + size) kept until acknowledged
+	Clock::time_point reliable_timer; //when the oldest unacknowledged byte was last (re)sent or acknowledged
+	struct SentSegment {
+		uint64_t end; //stream offset just past the segment
+		uint16_t sequence; //packet it went out in
+	};
+	std::deque< SentSegment > reliable_segments; //unacknowledged segments since the last go-back, in stream order
+
+	//---- reliable stream (receiving) ----
+	uint64_t reliable_received = 0; //have every byte before this offset
+	std::map< uint64_t, std::vector< uint8_t > > reliable_out_of_order; //segments past a gap, by offset
+	size_t out_of_order_bytes = 0;
+
+	//---- unreliable messages ----
+	struct Outgoing {
+		std::vector< uint8_t > header;
+		std::shared_ptr< std::vector< uint8_t > const > body;
+	};
+	std::deque< Outgoing > unreliable_queue; //sent (all of it) on the next poll
+	uint16_t next_message = 0;
+
+	struct Partial {
+		uint16_t message;
+		uint32_t fragments_left;
+		std::vector< std::vector< uint8_t > > fragments;
+	};
+	std::deque< Partial > partial_messages; //oldest first
+
+	//---- stats ----
+	uint64_t packets_sent = 0;
+	uint64_t packets_received = 0;
+	uint64_t retransmits = 0; //times the reliable stream went back to resend
+	uint64_t unreliable_dropped = 0; //partially-received messages given up on
+};
+
+struct DatagramEndpoint {
+	DatagramEndpoint(Socket socket, bool is_server);
+	~DatagramEndpoint();
+
+	Socket socket = InvalidSocket;
+	bool is_server = false;
+	std::unordered_map< std::string, Connection * > by_address; //(server) connection for each peer address
+	std::mt19937 mt; //(server) for choosing tokens
+};
+
+//make a server's socket bound to 'port':
+std::unique_ptr< DatagramEndpoint > datagram_listen(std::string const &port);
+
+//connect 'connection' to a server (blocks until the server accepts, throws if it doesn't):
+std::unique_ptr< DatagramEndpoint > datagram_connect(std::string const &host, std::string const &port, Connection *connection);
+
+//receive, handle timeouts, and send for every connection on 'endpoint' (waits up to 'timeout' for packets):
+void datagram_poll(
+	char const *where,
+	DatagramEndpoint &endpoint,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	NetSim::Settings const &netsim, //(packets pass through simulated links if enabled)
+	Socket wake_socket = InvalidSocket //(stop waiting early if this becomes readable; see Server::wake)
+);
+
+//tell the peer a connection is closing (called by Connection::close):
+void datagram_disconnect(Connection &connection);
@@ -1,19 +1,32 @@
 #include "Game.hpp"
 
 #include "Connection.hpp"
+#include "BitStream.hpp"
 
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/norm.hpp>
 
-void Player::Controls::send_controls_message(Connection *connection_) const {
+bool Player::Controls::changed_since(Controls const &sent) const {
+	auto changed = [](Button const &now, Button const &then) {
+		return now.pressed != then.pressed || now.downs != 0;
+	};
+	return changed(left, sent.left)
+	    || changed(right, sent.right)
+	    || changed(up, sent.up)
+	    || changed(down, sent.down)
+	    || changed(jump, sent.jump);
+}
+
+void Player::Controls::send_controls_message(Connection *connection_, uint32_t sequence) const {
 	assert(connection_);
 	auto &connection = *connection_;
 
-	uint32_t size = 5;
+	uint32_t size = 9;
 	connection.send(Message::C2S_Controls);
 	connection.send(uint8_t(size));
 	connection.send(uint8_t(size >> 8));
@@ -31,9 +44,10 @@ void Player::Controls::send_controls_message(Connection *connection_) const {
 	send_button(up);
 	send_button(down);
 	send_button(jump);
+	connection.send(sequence);
 }
 
-bool Player::Controls::recv_controls_message(Connection *connection_) {
+bool Player::Controls::recv_controls_message(Connection *connection_, uint32_t *sequence) {
 	assert(connection_);
 	auto &connection = *connection_;
 
@@ -45,7 +59,7 @@ bool Player::Controls::recv_controls_message(Connection *connection_) {
 	uint32_t size = (uint32_t(recv_buffer[3]) << 16)
 	              | (uint32_t(recv_buffer[2]) << 8)
 	              |  uint32_t(recv_buffer[1]);
-	if (size != 5) throw std::runtime_error("Controls message with size " + std::to_string(size) + " != 5!");
+	if (size != 9) throw std::runtime_error("Controls message with size " + std::to_string(size) + " != 9!");
 	
 	//expecting complete message:
 	if (recv_buffer.size() < 4 + size) return false;
@@ -65,14 +79,141 @@ bool Player::Controls::recv_controls_message(Connection *connection_) {
 	recv_button(recv_buffer[4+2], &up);
 	recv_button(recv_buffer[4+3], &down);
 	recv_button(recv_buffer[4+4], &jump);
+	if (sequence) std::memcpy(sequence, recv_buffer.data() + 4 + 5, sizeof(*sequence));
 
 	//delete message from buffer:
-	recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
+	recv_buffer.consume(4 + size);
 
 	return true;
 }
 
 
+//-----------------------------------------
+
+void StateAck::send_ack_message(Connection *connection_) const {
+	assert(connection_);
+	auto &connection = *connection_;
+
+	uint32_t size = 4;
+	connection.send(Message::C2S_Ack);
+	connection.send(uint8_t(size));
+	connection.send(uint8_t(size >> 8));
+	connection.send(uint8_t(size >> 16));
+	connection.send(tick);
+}
+
+bool StateAck::recv_ack_message(Connection *connection_) {
+	assert(connection_);
+	auto &connection = *connection_;
+
+	auto &recv_buffer = connection.recv_buffer;
+
+	//expecting [type, size_low0, size_mid8, size_high8]:
+	if (recv_buffer.size() < 4) return false;
+	if (recv_buffer[0] != uint8_t(Message::C2S_Ack)) return false;
+	uint32_t size = (uint32_t(recv_buffer[3]) << 16)
+	              | (uint32_t(recv_buffer[2]) << 8)
+	              |  uint32_t(recv_buffer[1]);
+	if (size != 4) throw std::runtime_error("Ack message with size " + std::to_string(size) + " != 4!");
+
+	//expecting complete message:
+	if (recv_buffer.size() < 4 + size) return false;
+
+	std::memcpy(&tick, recv_buffer.data() + 4, sizeof(tick));
+
+	//delete message from buffer:
+	recv_buffer.consume(4 + size);
+
+	return true;
+}
+
+//-----------------------------------------
+
+PlayerStore::Handle PlayerStore::add() {
+	Handle h = handles.allocate();
+	if (IdPool::index_of(h) >= index_of_handle.size()) {
+		index_of_handle.resize(IdPool::index_of(h) + 1, InvalidIndex);
+	}
+	index_of_handle[IdPool::index_of(h)] = uint32_t(size());
+
+	position.emplace_back(0.0f, 0.0f);
+	velocity.emplace_back(0.0f, 0.0f);
+	role.emplace_back(Player::Role::Hider);
+	is_ready.emplace_back(0);
+	is_caught.emplace_back(0);
+
+	controls.emplace_back();
+	color.emplace_back(1.0f, 1.0f, 1.0f);
+	name.emplace_back();
+	player_id.emplace_back(IdPool::InvalidId);
+
+	handle.emplace_back(h);
+
+	return h;
+}
+
+void PlayerStore::remove(Handle h) {
+	uint32_t i = index(h);
+	uint32_t last = uint32_t(size()) - 1;
+
+	//move the last player into the removed player's place:
+	if (i != last) {
+		position[i] = position[last];
+		velocity[i] = velocity[last];
+		role[i] = role[last];
+		is_ready[i] = is_ready[last];
+		is_caught[i] = is_caught[last];
+
+		controls[i] = controls[last];
+		color[i] = color[last];
+		name[i] = std::move(name[last]);
+		player_id[i] = player_id[last];
+
+		handle[i] = handle[last];
+		index_of_handle[IdPool::index_of(handle[i])] = i;
+	}
+
+	position.pop_back();
+	velocity.pop_back();
+	role.pop_back();
+	is_ready.pop_back();
+	is_caught.pop_back();
+
+	controls.pop_back();
+	color.pop_back();
+	name.pop_back();
+	player_id.pop_back();
+
+	handle.pop_back();
+
+	index_of_handle[IdPool::index_of(h)] = InvalidIndex;
+	handles.release(h);
+}
+
+void PlayerStore::clear() {
+	position.clear();
+	velocity.clear();
+	role.clear();
+	is_ready.clear();
+	is_caught.clear();
+
+	controls.clear();
+	color.clear();
+	name.clear();
+	player_id.clear();
+
+	handle.clear();
+	index_of_handle.clear();
+	handles.clear();
+}
+
+uint32_t PlayerStore::find_id(Player::Id id) const {
+	for (uint32_t i = 0; i < player_id.size(); ++i) {
+		if (player_id[i] == id) return i;
+	}
+	return InvalidIndex;
+}
+
 //-----------------------------------------
 
 Game::Game() : mt(0x15466666) {
@@ -81,46 +222,42 @@ Game::Game() : mt(0x15466666) {
 	
 }
 
-Player *Game::spawn_player() {
-	players.emplace_back();
-	Player &player = players.back();
+PlayerStore::Handle Game::spawn_player() {
+	PlayerStore::Handle handle = players.add();
+	uint32_t i = players.index(handle);
 
 	//random point in the middle area of the arena:
-	player.position.x = glm::mix(ArenaMin.x, ArenaMax.x, 0.1f + 0.8f * mt() / float(mt.max()));
-	player.position.y = glm::mix(ArenaMin.y, ArenaMax.y, 0.1f + 0.8f * mt() / float(mt.max()));
+	players.position[i].x = glm::mix(ArenaMin.x, ArenaMax.x, 0.1f + 0.8f * mt() / float(mt.max()));
+	players.position[i].y = glm::mix(ArenaMin.y, ArenaMax.y, 0.1f + 0.8f * mt() / float(mt.max()));
 
+	glm::vec3 &color = players.color[i];
 	do {
-		player.color.r = mt() / float(mt.max());
-		player.color.g = mt() / float(mt.max());
-		player.color.b = mt() / float(mt.max());
-	} while (player.color == glm::vec3(0.0f));
-	player.color = glm::normalize(player.color);
+		color.r = mt() / float(mt.max());
+		color.g = mt() / float(mt.max());
+		color.b = mt() / float(mt.max());
+	} while (color == glm::vec3(0.0f));
+	color = glm::normalize(color);
 
-	player.name = "Player " + std::to_string(next_player_number++);
+	players.name[i] = "Player " + std::to_string(next_player_number++);
 
-	player.role = players.size() == 1 ? Player::Role::Seeker : Player::Role::Hider;
+	players.role[i] = players.size() == 1 ? Player::Role::Seeker : Player::Role::Hider;
 	hider_count = players.size() == 0 ? 0 : players.size() - 1;
-	player.is_ready = false;
-	player.player_id = current_player_id;
-	current_player_id++;
-	player.is_caught = false;
+	players.is_ready[i] = false;
+	players.player_id[i] = player_ids.allocate();
+	players.is_caught[i] = false;
 	
-	return &player;
+	return handle;
 }
 
-void Game::remove_player(Player *player) {
-	bool found = false;
-	for (auto pi = players.begin(); pi != players.end(); ++pi) {
-		if (&*pi == player) {
-			players.erase(pi);
-			found = true;
-			break;
-		}
-	}
-	assert(found);
+void Game::remove_player(PlayerStore::Handle handle) {
+	assert(players.contains(handle));
+	player_ids.release(players.player_id[players.index(handle)]);
+	players.remove(handle);
 }
 
 void Game::update(float elapsed) {
+	tick += 1;
+
 	if (game_state == GameState::SeekerWin || game_state == GameState::HiderWin) {
 		return;
 	}
@@ -128,17 +265,17 @@ void Game::update(float elapsed) {
 	if (game_state == GameState::BeforeStart) {
 		all_is_ready = (players.size() >= 2);
 
-		for (auto &p : players) {
-			if (p.controls.jump.downs > 0) {
-				p.is_ready = true;
+		for (uint32_t i = 0; i < players.size(); ++i) {
+			if (players.controls[i].jump.downs > 0) {
+				players.is_ready[i] = true;
 			}
 			
 		}
 
 	}
 
-	for (auto &p : players) {
-		all_is_ready &= p.is_ready;
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		all_is_ready &= bool(players.is_ready[i]);
 	}
 
 	if (all_is_ready) {	
@@ -158,250 +295,629 @@ void Game::update(float elapsed) {
 		}
 	}
 
-	//position/velocity update:
-	for (auto &p : players) {
-		glm::vec2 dir = glm::vec2(0.0f, 0.0f);
-		if (p.controls.left.pressed) dir.x -= 1.0f;
-		if (p.controls.right.pressed) dir.x += 1.0f;
-		if (p.controls.down.pressed) dir.y -= 1.0f;
-		if (p.controls.up.pressed) dir.y += 1.0f;
+	//velocity update (from controls):
+	Movement const movement(elapsed);
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		Player::Controls &controls = players.controls[i];
+		players.velocity[i] = movement.steer(players.velocity[i], controls);
 
-		if (dir == glm::vec2(0.0f)) {
-			//no inputs: just drift to a stop
-			float amt = 1.0f - std::pow(0.5f, elapsed / (PlayerAccelHalflife * 2.0f));
-			p.velocity = glm::mix(p.velocity, glm::vec2(0.0f,0.0f), amt);
-		} else {
-			//inputs: tween velocity to target direction
-			dir = glm::normalize(dir);
+		//reset 'downs' since controls have been handled:
+		controls.left.downs = 0;
+		controls.right.downs = 0;
+		controls.up.downs = 0;
+		controls.down.downs = 0;
+		controls.jump.downs = 0;
+	}
+
+	//position update:
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		players.position[i] = movement.advance(players.position[i], players.velocity[i], players.role[i]);
+	}
+
+	
 
-			float amt = 1.0f - std::pow(0.5f, elapsed / PlayerAccelHalflife);
+	//collision resolution:
 
-			//accelerate along velocity (if not fast enough):
-			float along = glm::dot(p.velocity, dir);
-			if (along < PlayerSpeed) {
-				along = glm::mix(along, PlayerSpeed, amt);
+	//player/player collision response (shared by the grid and brute-force paths):
+	auto collide_players = [this](uint32_t i1, uint32_t i2) {
+		glm::vec2 p12 = players.position[i2] - players.position[i1];
+		float len2 = glm::length2(p12);
+		if (len2 > (2.0f * PlayerRadius) * (2.0f * PlayerRadius)) return;
+		if (len2 == 0.0f) return;
+
+		Player::Role role1 = players.role[i1];
+		Player::Role role2 = players.role[i2];
+		if (game_state == GameState::Playing &&
+			((role1 == Player::Role::Seeker && role2 == Player::Role::Hider) ||
+			(role1 == Player::Role::Hider && role2 == Player::Role::Seeker))) 
+		{
+			caught_hider_count++;
+			if (role1 == Player::Role::Hider) {
+				players.is_caught[i1] = true;
+				return;
+			}
+			else if (role2 == Player::Role::Hider) {
+				players.is_caught[i2] = true;
+				return;
 			}
 
-			//damp perpendicular velocity:
-			float perp = glm::dot(p.velocity, glm::vec2(-dir.y, dir.x));
-			perp = glm::mix(perp, 0.0f, amt);
+		}
+
+		glm::vec2 dir = p12 / std::sqrt(len2);
+		//mirror velocity to be in separating direction:
+		glm::vec2 v12 = players.velocity[i2] - players.velocity[i1];
+		glm::vec2 delta_v12 = dir * glm::max(0.0f, -1.75f * glm::dot(dir, v12));
+		players.velocity[i2] += 0.5f * delta_v12;
+		players.velocity[i1] -= 0.5f * delta_v12;
+	};
+
+	//each player is checked against the players before it (after their arena collisions),
+	// and is added to the grid once its own collisions are done:
+	collision_grid.clear(CollisionCellSize, players.size());
 
-			p.velocity = dir * along + glm::vec2(-dir.y, dir.x) * perp;
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		if (players.is_caught[i]) continue;
+
+		//player/player collisions:
+		if (brute_force_collisions) {
+			for (uint32_t j = 0; j < i; ++j) {
+				if (players.is_caught[j]) continue;
+				collide_players(i, j);
+			}
+		} else {
+			collision_grid.query(players.position[i], 2.0f * PlayerRadius, &collision_candidates);
+			for (uint32_t j : collision_candidates) {
+				if (players.is_caught[j]) continue;
+				collide_players(i, j);
+			}
+		}
+		if (players.is_caught[i]) {
+			//a player caught during its own checks is also checked against every player after it
+			// (a quirk of the all-pairs loop the grid replaced; kept so catches come out the same):
+			for (uint32_t j = i + 1; j < players.size(); ++j) {
+				if (players.is_caught[j]) continue;
+				collide_players(i, j);
+			}
+			continue;
 		}
-		if (p.role == Player::Role::Seeker) p.position += 1.15f * p.velocity * elapsed;
-		else p.position += p.velocity * elapsed;
 
-		//reset 'downs' since controls have been handled:
-		p.controls.left.downs = 0;
-		p.controls.right.downs = 0;
-		p.controls.up.downs = 0;
-		p.controls.down.downs = 0;
-		p.controls.jump.downs = 0;
+		//player/arena collisions:
+		Movement::clamp_to_arena(&players.position[i], &players.velocity[i]);
+
+		collision_grid.insert(i, players.position[i]);
 	}
 
+	angle += speed * elapsed;
+	spotlight.dir = glm::normalize(glm::vec3(1.3f * std::cos(angle), 1.3f * std::sin(angle), -1.0f));
 	
+}
 
-	//collision resolution:
-	for (auto &p1 : players) {
-		if (p1.is_caught) continue;
-		//player/player collisions:
-		for (auto &p2 : players) {
-			if (p2.is_caught) continue;
-
-			if (&p1 == &p2) break;
-			glm::vec2 p12 = p2.position - p1.position;
-			float len2 = glm::length2(p12);
-			if (len2 > (2.0f * PlayerRadius) * (2.0f * PlayerRadius)) continue;
-			if (len2 == 0.0f) continue;
-
-			if (game_state == GameState::Playing &&
-				((p1.role == Player::Role::Seeker && p2.role == Player::Role::Hider) ||
-				(p1.role == Player::Role::Hider && p2.role == Player::Role::Seeker))) 
-			{
-				caught_hider_count++;
-				if (p1.role == Player::Role::Hider) {
-					p1.is_caught = true;
-					continue;
-				}
-				else if (p2.role == Player::Role::Hider) {
-					p2.is_caught = true;
-					continue;
-				}
 
-			}
+Game::Movement::Movement(float elapsed_) : elapsed(elapsed_),
+	drift_amt(1.0f - std::pow(0.5f, elapsed_ / (PlayerAccelHalflife * 2.0f))),
+	input_amt(1.0f - std::pow(0.5f, elapsed_ / PlayerAccelHalflife)) {
+}
 
-			glm::vec2 dir = p12 / std::sqrt(len2);
-			//mirror velocity to be in separating direction:
-			glm::vec2 v12 = p2.velocity - p1.velocity;
-			glm::vec2 delta_v12 = dir * glm::max(0.0f, -1.75f * glm::dot(dir, v12));
-			p2.velocity += 0.5f * delta_v12;
-			p1.velocity -= 0.5f * delta_v12;
+glm::vec2 Game::Movement::steer(glm::vec2 velocity, Player::Controls const &controls) const {
+	glm::vec2 dir = glm::vec2(0.0f, 0.0f);
+	if (controls.left.pressed) dir.x -= 1.0f;
+	if (controls.right.pressed) dir.x += 1.0f;
+	if (controls.down.pressed) dir.y -= 1.0f;
+	if (controls.up.pressed) dir.y += 1.0f;
+
+	if (dir == glm::vec2(0.0f)) {
+		//no inputs: just drift to a stop
+		return glm::mix(velocity, glm::vec2(0.0f,0.0f), drift_amt);
+	} else {
+		//inputs: tween velocity to target direction
+		dir = glm::normalize(dir);
+
+		//accelerate along velocity (if not fast enough):
+		float along = glm::dot(velocity, dir);
+		if (along < PlayerSpeed) {
+			along = glm::mix(along, PlayerSpeed, input_amt);
 		}
-		if (p1.is_caught) continue;
 
-		//player/arena collisions:
-		if (p1.position.x < ArenaMin.x + PlayerRadius) {
-			p1.position.x = ArenaMin.x + PlayerRadius;
-			p1.velocity.x = std::abs(p1.velocity.x);
-		}
-		if (p1.position.x > ArenaMax.x - PlayerRadius) {
-			p1.position.x = ArenaMax.x - PlayerRadius;
-			p1.velocity.x =-std::abs(p1.velocity.x);
+		//damp perpendicular velocity:
+		float perp = glm::dot(velocity, glm::vec2(-dir.y, dir.x));
+		perp = glm::mix(perp, 0.0f, input_amt);
+
+		return dir * along + glm::vec2(-dir.y, dir.x) * perp;
+	}
+}
+
+glm::vec2 Game::Movement::advance(glm::vec2 position, glm::vec2 velocity, Player::Role role) const {
+	if (role == Player::Role::Seeker) return position + 1.15f * velocity * elapsed;
+	else return position + velocity * elapsed;
+}
+
+void Game::Movement::clamp_to_arena(glm::vec2 *position_, glm::vec2 *velocity_) {
+	glm::vec2 &position = *position_;
+	glm::vec2 &velocity = *velocity_;
+	if (position.x < ArenaMin.x + PlayerRadius) {
+		position.x = ArenaMin.x + PlayerRadius;
+		velocity.x = std::abs(velocity.x);
+	}
+	if (position.x > ArenaMax.x - PlayerRadius) {
+		position.x = ArenaMax.x - PlayerRadius;
+		velocity.x =-std::abs(velocity.x);
+	}
+	if (position.y < ArenaMin.y + PlayerRadius) {
+		position.y = ArenaMin.y + PlayerRadius;
+		velocity.y = std::abs(velocity.y);
+	}
+	if (position.y > ArenaMax.y - PlayerRadius) {
+		position.y = ArenaMax.y - PlayerRadius;
+		velocity.y =-std::abs(velocity.y);
+	}
+}
+
+
+//state messages are bit-packed (see BitStream.hpp):
+// floats are quantized to fixed point over the range the game can produce,
+// counts/ids/ticks are varints, and flags take a single bit.
+//each player is described with a mask of which fields follow:
+// (full states send every field; delta states only the ones that differ from the baseline)
+namespace {
+	enum PlayerField : uint8_t {
+		FieldPosition = 0x01,
+		FieldVelocity = 0x02,
+		FieldColor = 0x04,
+		FieldRole = 0x08,
+		FieldReady = 0x10,
+		FieldCaught = 0x20,
+		FieldName = 0x40,
+		FieldAll = 0x7f,
+	};
+	constexpr uint32_t PlayerFieldBits = 7;
+
+	enum GlobalField : uint8_t {
+		GlobalSpotlightPos = 0x01,
+		GlobalSpotlightDir = 0x02,
+		GlobalSpotlightEnergy = 0x04,
+		GlobalSpotlightCutoff = 0x08,
+		GlobalTimer = 0x10,
+		GlobalGameState = 0x20,
+		GlobalAll = 0x3f,
+	};
+	constexpr uint32_t GlobalFieldBits = 6;
+
+	using namespace StateQuantizers;
+
+	//positions are quantized over the arena (with some margin); anything outside that range is sent as
+	// a raw float after an escape bit, since caught players keep moving and aren't kept inside the arena:
+	void write_position(BitWriter &writer, Quantizer const &q, float value) {
+		bool escape = !q.contains(value);
+		writer.write_bool(escape);
+		if (escape) {
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			writer.write_bits(bits, 32);
+		} else {
+			q.write(writer, value);
 		}
-		if (p1.position.y < ArenaMin.y + PlayerRadius) {
-			p1.position.y = ArenaMin.y + PlayerRadius;
-			p1.velocity.y = std::abs(p1.velocity.y);
+	}
+	float read_position(BitReader &reader, Quantizer const &q) {
+		if (reader.read_bool()) {
+			uint32_t bits = reader.read_bits(32);
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		} else {
+			return q.read(reader);
 		}
-		if (p1.position.y > ArenaMax.y - PlayerRadius) {
-			p1.position.y = ArenaMax.y - PlayerRadius;
-			p1.velocity.y =-std::abs(p1.velocity.y);
+	}
+	//would 'a' and 'b' arrive as the same value?
+	bool same_position(Quantizer const &q, float a, float b) {
+		if (q.contains(a) && q.contains(b)) return q.quantize(a) == q.quantize(b);
+		return std::memcmp(&a, &b, sizeof(a)) == 0;
+	}
+
+	template< typename V >
+	bool same_quantized(Quantizer const &q, V const &a, V const &b) {
+		for (uint32_t i = 0; i < uint32_t(V::length()); ++i) {
+			if (q.quantize(a[i]) != q.quantize(b[i])) return false;
 		}
+		return true;
 	}
 
+	//which fields of players[i] differ from base[b] (at wire precision):
+	uint8_t changed_fields(PlayerStore const &base, uint32_t b, PlayerStore const &players, uint32_t i) {
+		uint8_t mask = 0;
+		if (!same_position(PositionX, players.position[i].x, base.position[b].x)
+		 || !same_position(PositionY, players.position[i].y, base.position[b].y)) mask |= FieldPosition;
+		if (!same_quantized(Velocity, players.velocity[i], base.velocity[b])) mask |= FieldVelocity;
+		if (!same_quantized(Color, players.color[i], base.color[b])) mask |= FieldColor;
+		if (players.role[i] != base.role[b]) mask |= FieldRole;
+		if (players.is_ready[i] != base.is_ready[b]) mask |= FieldReady;
+		if (players.is_caught[i] != base.is_caught[b]) mask |= FieldCaught;
+		if (players.name[i] != base.name[b]) mask |= FieldName;
+		return mask;
+	}
 
-	angle += speed * elapsed;
-	spotlight.dir = glm::normalize(glm::vec3(1.3f * std::cos(angle), 1.3f * std::sin(angle), -1.0f));
-	
+	template< typename V >
+	void write_quantized(BitWriter &writer, Quantizer const &q, V const &v) {
+		for (uint32_t i = 0; i < uint32_t(V::length()); ++i) {
+			q.write(writer, v[i]);
+		}
+	}
+	template< typename V >
+	void read_quantized(BitReader &reader, Quantizer const &q, V *v) {
+		for (uint32_t i = 0; i < uint32_t(V::length()); ++i) {
+			(*v)[i] = q.read(reader);
+		}
+	}
+
+	//player ids are sent as two varints (index, then generation), since both are usually small:
+	void write_id(BitWriter &writer, Player::Id id) {
+		writer.write_varint(IdPool::index_of(id));
+		writer.write_varint(IdPool::generation_of(id));
+	}
+	Player::Id read_id(BitReader &reader) {
+		uint32_t index = reader.read_varint();
+		uint32_t generation = reader.read_varint();
+		if (index >= IdPool::IndexMask || generation > IdPool::GenerationMask) {
+			throw std::runtime_error("State message has out-of-range player id.");
+		}
+		return IdPool::make_id(index, generation);
+	}
 }
 
+std::shared_ptr< std::vector< uint8_t > const > Game::encode_state(Snapshot const *baseline) const {
+	//every client has every player:
+	View baseline_view;
+	if (baseline) {
+		baseline_view.reserve(baseline->players.size());
+		for (uint32_t b = 0; b < baseline->players.size(); ++b) {
+			baseline_view.emplace_back(ViewRow{ baseline->players.player_id[b], baseline->tick, b });
+		}
+	}
+	return encode_state(baseline, baseline_view, {}, nullptr);
+}
 
-void Game::send_state_message(Connection *connection_, Player *connection_player) const {
-	assert(connection_);
-	auto &connection = *connection_;
+std::shared_ptr< std::vector< uint8_t > const > Game::encode_state(Snapshot const *baseline, View const &baseline_view, std::vector< Relevance > const &relevance, View *view) const {
+	assert(relevance.empty() || relevance.size() == players.size());
+	assert(baseline || baseline_view.empty());
+	auto state = std::make_shared< std::vector< uint8_t > >();
+	BitWriter writer(state.get());
+
+	//send (some fields of) player info helper:
+	auto send_player = [&](uint32_t i, uint8_t mask) {
+		write_id(writer, players.player_id[i]);
+		writer.write_bits(mask, PlayerFieldBits);
+		if (mask & FieldPosition) {
+			write_position(writer, PositionX, players.position[i].x);
+			write_position(writer, PositionY, players.position[i].y);
+		}
+		if (mask & FieldVelocity) write_quantized(writer, Velocity, players.velocity[i]);
+		if (mask & FieldColor) write_quantized(writer, Color, players.color[i]);
+		if (mask & FieldRole) writer.write_bits(uint32_t(players.role[i]), 1);
+		if (mask & FieldReady) writer.write_bool(players.is_ready[i]);
+		if (mask & FieldCaught) writer.write_bool(players.is_caught[i]);
+		if (mask & FieldName) {
+			//effectively: truncates player name to 255 chars
+			std::string const &name = players.name[i];
+			uint32_t len = uint32_t(std::min< size_t >(255, name.size()));
+			writer.write_varint(len);
+			for (uint32_t n = 0; n < len; ++n) {
+				writer.write_bits(uint8_t(name[n]), 8);
+			}
+		}
+	};
 
-	connection.send(Message::S2C_State);
-	//will patch message size in later, for now placeholder bytes:
-	connection.send(uint8_t(0));
-	connection.send(uint8_t(0));
-	connection.send(uint8_t(0));
-	size_t mark = connection.send_buffer.size(); //keep track of this position in the buffer
-
-
-	//send player info helper:
-	auto send_player = [&](Player const &player) {
-		connection.send(player.position);
-		connection.send(player.velocity);
-		connection.send(player.color);
-		
-		connection.send(uint8_t(player.role));
-		connection.send(uint8_t(player.is_ready));
-		connection.send(player.player_id);
-		connection.send(uint8_t(player.is_caught));
-
-		//NOTE: can't just 'send(name)' because player.name is not plain-old-data type.
-		//effectively: truncates player name to 255 chars
-		uint8_t len = uint8_t(std::min< size_t >(255, player.name.size()));
-		connection.send(len);
-		connection.send_buffer.insert(connection.send_buffer.end(), player.name.begin(), player.name.begin() + len);
+	//header: this tick, and the (acknowledged) tick the message is relative to:
+	writer.write_varint(tick);
+	writer.write_bool(baseline != nullptr);
+	if (baseline) writer.write_varint(tick - baseline->tick);
+
+	//global state:
+	uint8_t global_mask = GlobalAll;
+	if (baseline) {
+		global_mask = 0;
+		if (!same_quantized(SpotlightPos, spotlight.pos, baseline->spotlight.pos)) global_mask |= GlobalSpotlightPos;
+		if (!same_quantized(SpotlightDir, spotlight.dir, baseline->spotlight.dir)) global_mask |= GlobalSpotlightDir;
+		if (!same_quantized(SpotlightEnergy, spotlight.energy, baseline->spotlight.energy)) global_mask |= GlobalSpotlightEnergy;
+		if (SpotlightCutoff.quantize(spotlight.cutoff) != SpotlightCutoff.quantize(baseline->spotlight.cutoff)) global_mask |= GlobalSpotlightCutoff;
+		if (Timer.quantize(timer) != Timer.quantize(baseline->timer)) global_mask |= GlobalTimer;
+		if (game_state != baseline->game_state) global_mask |= GlobalGameState;
+	}
+	writer.write_bits(global_mask, GlobalFieldBits);
+	if (global_mask & GlobalSpotlightPos) write_quantized(writer, SpotlightPos, spotlight.pos);
+	if (global_mask & GlobalSpotlightDir) write_quantized(writer, SpotlightDir, spotlight.dir);
+	if (global_mask & GlobalSpotlightEnergy) write_quantized(writer, SpotlightEnergy, spotlight.energy);
+	if (global_mask & GlobalSpotlightCutoff) SpotlightCutoff.write(writer, spotlight.cutoff);
+	if (global_mask & GlobalTimer) Timer.write(writer, timer);
+	if (global_mask & GlobalGameState) writer.write_bits(uint32_t(game_state), 2);
+
+	//the baseline players (as the client has them), from the snapshots they were sent from:
+	struct BaseRow {
+		PlayerStore const *store;
+		uint32_t index;
 	};
+	std::vector< BaseRow > base_rows;
+	base_rows.reserve(baseline_view.size());
+	for (ViewRow const &row : baseline_view) {
+		Snapshot const *snapshot = find_snapshot(row.tick);
+		assert(snapshot && row.index < snapshot->players.size() && snapshot->players.player_id[row.index] == row.id);
+		base_rows.emplace_back(BaseRow{ &snapshot->players, row.index });
+	}
 
-	//send spotlight info helper:
-	auto send_spotlight = [&](Spotlight const &s) {
-		connection.send(s.pos);
-		connection.send(s.dir);
-    	connection.send(s.energy);
-		connection.send(s.cutoff);
+	auto relevance_of = [&](uint32_t i) {
+		return relevance.empty() ? Relevance::Update : relevance[i];
 	};
 
-	//player count:
-	connection.send(uint8_t(players.size()));
-	if (connection_player) send_player(*connection_player);
-	for (auto const &player : players) {
-		if (&player == connection_player) continue;
-		send_player(player);
+	//current and baseline players, by id index:
+	// (an index may have been reused since the baseline, so entries are checked against the whole id)
+	uint32_t index_limit = 0;
+	for (Player::Id id : players.player_id) {
+		index_limit = std::max(index_limit, IdPool::index_of(id) + 1);
+	}
+	for (ViewRow const &row : baseline_view) {
+		index_limit = std::max(index_limit, IdPool::index_of(row.id) + 1);
+	}
+	std::vector< uint32_t > current_index(index_limit, PlayerStore::InvalidIndex);
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		current_index[IdPool::index_of(players.player_id[i])] = i;
+	}
+	std::vector< uint32_t > base_index(index_limit, PlayerStore::InvalidIndex);
+	for (uint32_t r = 0; r < baseline_view.size(); ++r) {
+		base_index[IdPool::index_of(baseline_view[r].id)] = r;
 	}
 
-	
-	send_spotlight(spotlight);
-	connection.send(timer);
-	connection.send(uint8_t(game_state));
-
-	//compute the message size and patch into the message header:
-	uint32_t size = uint32_t(connection.send_buffer.size() - mark);
-	connection.send_buffer[mark-3] = uint8_t(size);
-	connection.send_buffer[mark-2] = uint8_t(size >> 8);
-	connection.send_buffer[mark-1] = uint8_t(size >> 16);
+	//players that have left (or are no longer shown) since the baseline:
+	{
+		auto is_removed = [&](Player::Id id) {
+			uint32_t i = current_index[IdPool::index_of(id)];
+			return i == PlayerStore::InvalidIndex || players.player_id[i] != id || relevance_of(i) == Relevance::Hidden;
+		};
+		uint32_t removed = 0;
+		for (ViewRow const &row : baseline_view) {
+			if (is_removed(row.id)) removed += 1;
+		}
+		writer.write_varint(removed);
+		for (ViewRow const &row : baseline_view) {
+			if (is_removed(row.id)) write_id(writer, row.id);
+		}
+	}
+
+	//players that are new or changed since the baseline:
+	{
+		if (view) {
+			view->clear();
+			view->reserve(players.size());
+		}
+		std::vector< uint8_t > masks;
+		masks.reserve(players.size());
+		uint32_t changed = 0;
+		for (uint32_t i = 0; i < players.size(); ++i) {
+			Player::Id id = players.player_id[i];
+			Relevance r = relevance_of(i);
+			uint32_t b = base_index[IdPool::index_of(id)];
+			bool in_base = (b != PlayerStore::InvalidIndex && baseline_view[b].id == id);
+			uint8_t mask = 0;
+			if (r == Relevance::Hidden) {
+				//(left out)
+			} else if (!in_base) {
+				if (r == Relevance::Update) mask = FieldAll;
+			} else {
+				mask = changed_fields(*base_rows[b].store, base_rows[b].index, players, i);
+				//deferred players only go out for changes that matter more than motion:
+				if (r == Relevance::Defer && (mask & ~(FieldPosition | FieldVelocity)) == 0) mask = 0;
+			}
+			masks.emplace_back(mask);
+			if (mask != 0) changed += 1;
+
+			if (view && r != Relevance::Hidden) {
+				//the client now has this player as of this tick, or still as it was in the baseline:
+				if (mask != 0 || (in_base && r == Relevance::Update)) view->emplace_back(ViewRow{ id, tick, i });
+				else if (in_base) view->emplace_back(baseline_view[b]);
+			}
+		}
+		writer.write_varint(changed);
+		for (uint32_t i = 0; i < players.size(); ++i) {
+			if (masks[i] != 0) send_player(i, masks[i]);
+		}
+	}
+
+	writer.flush();
+
+	return state;
 }
 
-bool Game::recv_state_message(Connection *connection_) {
+void Game::send_state_message(Connection *connection_, Player::Id connection_player_id, uint32_t controls_sequence, uint16_t controls_ticks, std::shared_ptr< std::vector< uint8_t > const > const &state) {
 	assert(connection_);
 	auto &connection = *connection_;
-	auto &recv_buffer = connection.recv_buffer;
+	assert(state);
+
+	//per-connection header: which player (if any) this connection controls, and which of its controls are included:
+	uint32_t size = 10 + uint32_t(state->size());
+	uint8_t header[4 + 10];
+	header[0] = uint8_t(Message::S2C_State);
+	header[1] = uint8_t(size);
+	header[2] = uint8_t(size >> 8);
+	header[3] = uint8_t(size >> 16);
+	std::memcpy(header + 4, &connection_player_id, sizeof(connection_player_id));
+	std::memcpy(header + 4 + 4, &controls_sequence, sizeof(controls_sequence));
+	std::memcpy(header + 4 + 8, &controls_ticks, sizeof(controls_ticks));
+
+	//shared body (not copied); only the newest state matters, so it can go on the unreliable channel:
+	connection.send_unreliable(header, sizeof(header), state);
+}
 
-	if (recv_buffer.size() < 4) return false;
-	if (recv_buffer[0] != uint8_t(Message::S2C_State)) return false;
-	uint32_t size = (uint32_t(recv_buffer[3]) << 16)
-	              | (uint32_t(recv_buffer[2]) << 8)
-	              |  uint32_t(recv_buffer[1]);
-	uint32_t at = 0;
-	//expecting complete message:
-	if (recv_buffer.size() < 4 + size) return false;
+void Game::send_state_message(Connection *connection, PlayerStore::Handle connection_player) const {
+	Player::Id id = IdPool::InvalidId;
+	if (connection_player != PlayerStore::InvalidHandle) id = players.player_id[players.index(connection_player)];
+	send_state_message(connection, id, 0, 0, encode_state());
+}
+
+uint32_t Game::local_player() const {
+	if (local_player_id == IdPool::InvalidId) return PlayerStore::InvalidIndex;
+	return players.find_id(local_player_id);
+}
 
-	//copy bytes from buffer and advance position:
-	auto read = [&](auto *val) {
-		if (at + sizeof(*val) > size) {
-			throw std::runtime_error("Ran out of bytes reading state message.");
+bool Game::recv_state_message(Connection *connection_) {
+	assert(connection_);
+	auto &connection = *connection_;
+
+	//state messages arrive on the reliable stream (TCP) or the unreliable channel (UDP);
+	// take the next complete one from either, skipping any not newer than the current state (UDP may reorder them):
+	ByteQueue *buffer = nullptr;
+	uint32_t size = 0;
+	while (true) {
+		buffer = nullptr;
+		for (ByteQueue *queue : { &connection.recv_buffer, &connection.unreliable_recv_buffer }) {
+			if (queue->size() < 4) continue;
+			if ((*queue)[0] != uint8_t(Message::S2C_State)) continue;
+			size = (uint32_t((*queue)[3]) << 16)
+			     | (uint32_t((*queue)[2]) << 8)
+			     |  uint32_t((*queue)[1]);
+			//expecting complete message:
+			if (queue->size() < 4 + size) continue;
+			buffer = queue;
+			break;
 		}
-		std::memcpy(val, &recv_buffer[4 + at], sizeof(*val));
-		at += sizeof(*val);
-	};
+		if (!buffer) return false;
+
+		if (size < 10) throw std::runtime_error("State message too short.");
+		if (!received_state) break;
+		uint32_t message_tick = BitReader(buffer->data() + 4 + 10, size - 10).read_varint();
+		if (int32_t(message_tick - tick) > 0) break;
+		buffer->consume(4 + size);
+	}
+	auto &recv_buffer = *buffer;
+
+	//per-connection header:
+	std::memcpy(&local_player_id, recv_buffer.data() + 4, sizeof(local_player_id));
+	std::memcpy(&local_controls_sequence, recv_buffer.data() + 4 + 4, sizeof(local_controls_sequence));
+	std::memcpy(&local_controls_ticks, recv_buffer.data() + 4 + 8, sizeof(local_controls_ticks));
+
+	//shared (bit-packed) state:
+	BitReader reader(recv_buffer.data() + 4 + 10, size - 10);
+
+	uint32_t message_tick = reader.read_varint();
+
+	//start from the baseline snapshot (if this is a delta) or from nothing,
+	// updating 'players' in place so a steady stream of states doesn't allocate:
+	// (copy-assignment reuses the vectors' and names' storage; if the message turns out to be malformed,
+	//  'players' is left partly updated, but callers drop the connection then anyway)
+	bool is_delta = reader.read_bool();
+	PlayerStore &next = players;
+	if (is_delta) {
+		uint32_t baseline_tick = message_tick - reader.read_varint();
+		Snapshot const *baseline = find_snapshot(baseline_tick);
+		if (!baseline) throw std::runtime_error("State message relative to unknown tick " + std::to_string(baseline_tick) + ".");
+		//(nothing to copy if the baseline is the state we already have)
+		if (!(received_state && baseline_tick == tick)) next = baseline->players;
+		spotlight = baseline->spotlight;
+		timer = baseline->timer;
+		game_state = baseline->game_state;
+	} else {
+		next.clear();
+	}
 
-	//read spotlight info helper:
-	auto read_spotlight = [&]() {
-		read(&spotlight.pos);
-		read(&spotlight.dir);
-		read(&spotlight.energy);
-		read(&spotlight.cutoff);
+	uint8_t global_mask = uint8_t(reader.read_bits(GlobalFieldBits));
+	if (!is_delta && global_mask != GlobalAll) throw std::runtime_error("Full state message missing global state.");
+	if (global_mask & GlobalSpotlightPos) read_quantized(reader, SpotlightPos, &spotlight.pos);
+	if (global_mask & GlobalSpotlightDir) read_quantized(reader, SpotlightDir, &spotlight.dir);
+	if (global_mask & GlobalSpotlightEnergy) read_quantized(reader, SpotlightEnergy, &spotlight.energy);
+	if (global_mask & GlobalSpotlightCutoff) spotlight.cutoff = SpotlightCutoff.read(reader);
+	if (global_mask & GlobalTimer) timer = Timer.read(reader);
+	if (global_mask & GlobalGameState) game_state = GameState(reader.read_bits(2));
+
+	//players by id index:
+	std::vector< PlayerStore::Handle > &handle_of = decode_handles;
+	handle_of.clear();
+	auto handle_slot = [&handle_of](Player::Id id) -> PlayerStore::Handle & {
+		uint32_t index = IdPool::index_of(id);
+		if (index >= handle_of.size()) handle_of.resize(index + 1, PlayerStore::InvalidHandle);
+		return handle_of[index];
+	};
+	for (uint32_t i = 0; i < next.size(); ++i) {
+		handle_slot(next.player_id[i]) = next.handle[i];
+	}
+	//handle of the player with exactly this id (or InvalidHandle):
+	auto find_handle = [&](Player::Id id) {
+		PlayerStore::Handle handle = handle_slot(id);
+		if (handle != PlayerStore::InvalidHandle && next.player_id[next.index(handle)] != id) handle = PlayerStore::InvalidHandle;
+		return handle;
 	};
 
-	players.clear();
-	uint8_t player_count;
-	read(&player_count);
-	for (uint8_t i = 0; i < player_count; ++i) {
-		players.emplace_back();
-		Player &player = players.back();
-		read(&player.position);
-		read(&player.velocity);
-		read(&player.color);
-
-		uint8_t role;
-		read(&role);
-		player.role = Player::Role(role);
-
-		uint8_t ir;
-		read(&ir);
-		player.is_ready = (ir != 0);
-
-		read(&player.player_id);
-
-		uint8_t ic;
-		read(&ic);
-		player.is_caught = (ic != 0);
-
-		uint8_t name_len;
-		read(&name_len);
-		//n.b. would probably be more efficient to directly copy from recv_buffer, but I think this is clearer:
-		player.name = "";
-		for (uint8_t n = 0; n < name_len; ++n) {
-			char c;
-			read(&c);
-			player.name += c;
+	//players that have left:
+	uint32_t removed_count = reader.read_varint();
+	for (uint32_t i = 0; i < removed_count; ++i) {
+		Player::Id id = read_id(reader);
+		PlayerStore::Handle handle = find_handle(id);
+		if (handle == PlayerStore::InvalidHandle) throw std::runtime_error("State message removes unknown player.");
+		next.remove(handle);
+		handle_slot(id) = PlayerStore::InvalidHandle;
+	}
+
+	//players that are new or changed:
+	uint32_t changed_count = reader.read_varint();
+	for (uint32_t i = 0; i < changed_count; ++i) {
+		Player::Id id = read_id(reader);
+		uint8_t mask = uint8_t(reader.read_bits(PlayerFieldBits));
+
+		PlayerStore::Handle handle = find_handle(id);
+		if (handle == PlayerStore::InvalidHandle) {
+			//new players must send everything:
+			if (mask != FieldAll) throw std::runtime_error("State message adds player without all fields.");
+			if (handle_slot(id) != PlayerStore::InvalidHandle) throw std::runtime_error("State message reuses a player id without removing the old player.");
+			handle = next.add();
+			handle_slot(id) = handle;
+		}
+		uint32_t p = next.index(handle);
+		next.player_id[p] = id;
+
+		if (mask & FieldPosition) {
+			next.position[p].x = read_position(reader, PositionX);
+			next.position[p].y = read_position(reader, PositionY);
+		}
+		if (mask & FieldVelocity) read_quantized(reader, Velocity, &next.velocity[p]);
+		if (mask & FieldColor) read_quantized(reader, Color, &next.color[p]);
+		if (mask & FieldRole) next.role[p] = Player::Role(reader.read_bits(1));
+		if (mask & FieldReady) next.is_ready[p] = reader.read_bool();
+		if (mask & FieldCaught) next.is_caught[p] = reader.read_bool();
+		if (mask & FieldName) {
+			uint32_t name_len = reader.read_varint();
+			if (name_len > 255) throw std::runtime_error("State message has overlong player name.");
+			//(written over the old name, so its storage is reused)
+			std::string &name = next.name[p];
+			name.resize(name_len);
+			for (uint32_t n = 0; n < name_len; ++n) {
+				name[n] = char(reader.read_bits(8));
+			}
 		}
 	}
 
-	
-	read_spotlight();
-	
-	read(&timer);
+	if (!reader.at_end()) throw std::runtime_error("Trailing data in state message.");
 
-	uint8_t gs;
-	read(&gs);
-	game_state = GameState(gs);
+	tick = message_tick;
 
-	if (at != size) throw std::runtime_error("Trailing data in state message.");
+	//remember this state, since the server may send deltas against it once acknowledged:
+	record_snapshot();
+	received_state = true;
 
 	//delete message from buffer:
-	recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
+	recv_buffer.consume(4 + size);
 
 	return true;
 }
+
+//-----------------------------------------
+
+void Game::record_snapshot() {
+	Snapshot &snapshot = history[tick % SnapshotHistory];
+	snapshot.tick = tick;
+	snapshot.valid = true;
+	snapshot.players = players;
+	snapshot.spotlight = spotlight;
+	snapshot.timer = timer;
+	snapshot.game_state = game_state;
+}
+
+Game::Snapshot const *Game::find_snapshot(uint32_t tick_) const {
+	Snapshot const &snapshot = history[tick_ % SnapshotHistory];
+	if (!snapshot.valid || snapshot.tick != tick_) return nullptr;
+	return &snapshot;
+}
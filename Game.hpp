@@ -1,10 +1,17 @@
 #pragma once
 
+#include "SpatialHash.hpp"
+#include "IdPool.hpp"
+#include "BitStream.hpp"
+
 #include <glm/glm.hpp>
 
 #include <string>
-#include <list>
+#include <cassert>
 #include <random>
+#include <memory>
+#include <vector>
+#include <array>
 
 struct Connection;
 
@@ -21,6 +28,7 @@ struct Spotlight {
 
 enum class Message : uint8_t {
 	C2S_Controls = 1, //Greg!
+	C2S_Ack = 'a',
 	S2C_State = 's',
 	//...
 };
@@ -31,39 +39,100 @@ struct Button {
 	bool pressed = false; //is the button pressed now
 };
 
-//state of one player in the game:
+//types describing one player in the game:
+// (the players themselves are stored in a PlayerStore, below)
 struct Player {
 	//player inputs (sent from client):
 	struct Controls {
 		Button left, right, up, down, jump;
 
-		void send_controls_message(Connection *connection) const;
+		//should these be sent, given the controls last sent? (a button changed, or there are new presses)
+		// clients send controls only when this is true, plus a heartbeat every Game::ControlsHeartbeat:
+		bool changed_since(Controls const &sent) const;
+
+		//'sequence' numbers the message, so the server can say which controls a state includes:
+		void send_controls_message(Connection *connection, uint32_t sequence = 0) const;
 
 		//returns 'false' if no message or not a controls message,
-		//returns 'true' if read a controls message,
+		//returns 'true' if read a controls message (and stores its sequence number in 'sequence', if given),
 		//throws on malformed controls message
-		bool recv_controls_message(Connection *connection);
-	} controls;
+		bool recv_controls_message(Connection *connection, uint32_t *sequence = nullptr);
+	};
+
+	enum class Role : uint8_t { Seeker = 0, Hider = 1 };
 
-	//player state (sent from server):
-	glm::vec2 position = glm::vec2(0.0f, 0.0f);
-	glm::vec2 velocity = glm::vec2(0.0f, 0.0f);
+	//names a player in network messages (allocated by the server's IdPool, so never reused right away):
+	using Id = IdPool::Id;
+};
 
-	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
-	std::string name = "";
+//all the players in a game, stored as parallel arrays ("structure of arrays") indexed [0, size()):
+// - the data the simulation touches every tick (position, velocity, role, flags) is packed contiguously,
+//   and colder data (controls, color, name, id) is kept in its own arrays;
+// - removing a player moves the last player into its place, so indices change as players come and go;
+//   use a Handle to keep referring to the same player (handles are generational, so stale ones are detectable).
+struct PlayerStore {
+	using Handle = IdPool::Id;
+	inline static constexpr Handle InvalidHandle = IdPool::InvalidId;
+	inline static constexpr uint32_t InvalidIndex = ~0u;
 
-	enum class Role : uint8_t { Seeker = 0, Hider = 1 };
-	Role role;
+	size_t size() const { return position.size(); }
+	bool empty() const { return position.empty(); }
+
+	//add a player (with default state) after the current players; returns its handle:
+	Handle add();
+	//remove a player by moving the last player into its place:
+	void remove(Handle handle);
+	//remove all players (all handles become invalid):
+	void clear();
+
+	//does 'handle' refer to a player in the store?
+	bool contains(Handle handle) const {
+		return handles.is_live(handle);
+	}
+	//current index of a player:
+	uint32_t index(Handle handle) const {
+		assert(contains(handle));
+		return index_of_handle[IdPool::index_of(handle)];
+	}
+	//index of the player with a given (network) id, or InvalidIndex if there is none:
+	uint32_t find_id(Player::Id id) const;
 
-	bool is_ready;
-	uint8_t player_id;
-	bool is_caught;
+	//hot (simulation) data:
+	std::vector< glm::vec2 > position;
+	std::vector< glm::vec2 > velocity;
+	std::vector< Player::Role > role;
+	std::vector< uint8_t > is_ready; //(flags stored as bytes rather than vector< bool > so loops over them stay simple)
+	std::vector< uint8_t > is_caught;
+
+	//cold data:
+	std::vector< Player::Controls > controls; //(sent from client)
+	std::vector< glm::vec3 > color;
+	std::vector< std::string > name;
+	std::vector< Player::Id > player_id; //names the player in network messages
+
+	//handle bookkeeping:
+	std::vector< Handle > handle; //handle of the player at each index
+	std::vector< uint32_t > index_of_handle; //index of the player for each handle index (InvalidIndex if unused)
+	IdPool handles;
+};
+
+//client's acknowledgement of the latest state message it has received;
+// the server delta-compresses later state messages against acknowledged ticks:
+struct StateAck {
+	uint32_t tick = 0;
+
+	void send_ack_message(Connection *connection) const;
+
+	//returns 'false' if no message or not an ack message,
+	//returns 'true' if read an ack message,
+	//throws on malformed ack message
+	bool recv_ack_message(Connection *connection);
 };
 
 struct Game {
-	std::list< Player > players; //(using list so they can have stable addresses)
-	Player *spawn_player(); //add player the end of the players list (may also, e.g., play some spawn anim)
-	void remove_player(Player *); //remove player from game (may also, e.g., play some despawn anim)
+	PlayerStore players;
+	PlayerStore::Handle spawn_player(); //add player to the game (may also, e.g., play some spawn anim)
+	void remove_player(PlayerStore::Handle); //remove player from game (may also, e.g., play some despawn anim)
 
 	std::mt19937 mt; //used for spawning players
 	uint32_t next_player_number = 1; //used for naming players
@@ -90,6 +159,32 @@ struct Game {
 	// inline static constexpr float PlayerSpeed = 2.0f;
 	inline static constexpr float PlayerSpeed = 6.0f;
 	inline static constexpr float PlayerAccelHalflife = 0.25f;
+
+	//clients resend unchanged controls this often (seconds), so the server hears from idle clients:
+	inline static constexpr float ControlsHeartbeat = 0.25f;
+
+	//one player's movement for one step, without player/player collisions
+	// (used by update() and by client-side prediction of the local player):
+	struct Movement {
+		explicit Movement(float elapsed);
+		float elapsed;
+		float drift_amt; //how far velocity drifts toward zero with no inputs
+		float input_amt; //how far velocity tweens toward the input direction
+
+		//velocity after steering with 'controls':
+		glm::vec2 steer(glm::vec2 velocity, Player::Controls const &controls) const;
+		//position after moving at 'velocity':
+		glm::vec2 advance(glm::vec2 position, glm::vec2 velocity, Player::Role role) const;
+		//push a position back inside the arena, bouncing velocity off the walls:
+		static void clamp_to_arena(glm::vec2 *position, glm::vec2 *velocity);
+	};
+
+	//player/player collision broadphase:
+	// (cells are a hair wider than the collision distance so float rounding can't put touching players two cells apart)
+	inline static constexpr float CollisionCellSize = 2.0f * PlayerRadius * 1.001f;
+	SpatialHash collision_grid;
+	std::vector< uint32_t > collision_candidates; //(scratch, kept to avoid reallocating every update)
+	bool brute_force_collisions = false; //check every pair instead of using the grid (same results; for comparison)
 	
 
 	//---- communication helpers ----
@@ -99,10 +194,53 @@ struct Game {
 	// (return true if data was read)
 	bool recv_state_message(Connection *connection);
 
+	//used by client: which player the server says this client controls (from the last state message):
+	Player::Id local_player_id = IdPool::InvalidId;
+	//used by client: sequence number of the latest controls message the last state message includes,
+	// and how many ticks the server has simulated with those controls so far:
+	uint32_t local_controls_sequence = 0;
+	uint16_t local_controls_ticks = 0;
+	//used by client: has any state message been decoded yet? (after that, states older than 'tick' are skipped)
+	bool received_state = false;
+	//(scratch for recv_state_message: player handles by id index, kept so decoding doesn't allocate)
+	std::vector< PlayerStore::Handle > decode_handles;
+	//returns the index of the player controlled by this client, or PlayerStore::InvalidIndex if it isn't in the current state:
+	uint32_t local_player() const;
+
 	//used by server:
-	//send game state.
-	//  Will move "connection_player" to the front of the front of the sent list.
-	void send_state_message(Connection *connection, Player *connection_player = nullptr) const;
+	//encode the part of the state message that is the same for every client;
+	// do this once per tick (per distinct baseline) and share the result between connections.
+	// If 'baseline' is given, only fields that changed since that snapshot are encoded:
+	struct Snapshot; //(defined below)
+	std::shared_ptr< std::vector< uint8_t > const > encode_state(Snapshot const *baseline = nullptr) const;
+
+	//used by server with interest management (see Interest.hpp), where each client is sent its own subset of the players:
+	//what to tell one client about a player this tick:
+	enum class Relevance : uint8_t {
+		Update, //send whatever changed (or everything, if the client doesn't have the player)
+		Defer, //send only changes other than motion; the client keeps the position and velocity it has
+		Hidden, //leave out (and remove, if the client has the player)
+	};
+	//the players one client has, as rows of recorded snapshots (player 'id' as it was at 'tick', at 'index' in that snapshot):
+	struct ViewRow {
+		Player::Id id;
+		uint32_t tick;
+		uint32_t index;
+	};
+	using View = std::vector< ViewRow >;
+	//encode the state for one client, relative to 'baseline' (or full if nullptr), where
+	// 'baseline_view' is what the client had at the baseline tick (every row's snapshot must still be in history),
+	// 'relevance' gives what to do with each current player (by index),
+	// and the players the client has after this message are stored in 'view':
+	std::shared_ptr< std::vector< uint8_t > const > encode_state(Snapshot const *baseline, View const &baseline_view, std::vector< Relevance > const &relevance, View *view) const;
+
+	//send game state: a small per-connection header (the id of the player that is "you", or IdPool::InvalidId,
+	//  the sequence number of that player's latest applied controls message, and the ticks simulated with it)
+	//  followed by a reference to the shared state from encode_state():
+	static void send_state_message(Connection *connection, Player::Id connection_player_id, uint32_t controls_sequence, uint16_t controls_ticks, std::shared_ptr< std::vector< uint8_t > const > const &state);
+
+	//send game state (encoding a full state just for this connection):
+	void send_state_message(Connection *connection, PlayerStore::Handle connection_player = PlayerStore::InvalidHandle) const;
 
 	Spotlight spotlight;
 	float angle = 0.0f;
@@ -115,5 +253,56 @@ struct Game {
 
 	int hider_count = 0;
 	int caught_hider_count = 0;
-	uint8_t current_player_id = 0;
+	IdPool player_ids; //(server) gives each spawned player its Player::Id
+
+	//---- snapshot history (for delta-compressed state messages) ----
+
+	//tick number of the current state (advanced by update() on the server, read from state messages on the client):
+	uint32_t tick = 0;
+
+	//copy of the networked part of the state at some tick:
+	struct Snapshot {
+		uint32_t tick = 0;
+		bool valid = false;
+		PlayerStore players;
+		Spotlight spotlight;
+		float timer = 0.0f;
+		GameState game_state = GameState::BeforeStart;
+	};
+
+	//recent snapshots, indexed by tick % SnapshotHistory:
+	// (server records one per tick; client records every state message it decodes)
+	inline static constexpr uint32_t SnapshotHistory = 32;
+	std::array< Snapshot, SnapshotHistory > history;
+
+	//copy the current state into history:
+	void record_snapshot();
+	//look up the snapshot for a tick (nullptr if it has already left the history):
+	Snapshot const *find_snapshot(uint32_t tick) const;
 };
+
+//quantizers for the floats in state messages (see Game::encode_state):
+namespace StateQuantizers {
+	//positions: the arena, with some margin (positions outside this are sent exactly; see Game.cpp):
+	constexpr Quantizer PositionX{ Game::ArenaMin.x - 2.0f * Game::PlayerRadius, Game::ArenaMax.x + 2.0f * Game::PlayerRadius, 16 };
+	constexpr Quantizer PositionY{ Game::ArenaMin.y - 2.0f * Game::PlayerRadius, Game::ArenaMax.y + 2.0f * Game::PlayerRadius, 16 };
+	//velocities: up to PlayerSpeed from input, plus some extra from collision response:
+	constexpr Quantizer Velocity{ -2.0f * Game::PlayerSpeed, 2.0f * Game::PlayerSpeed, 16 };
+	//colors are normalized, so each channel is in [0,1]:
+	constexpr Quantizer Color{ 0.0f, 1.0f, 8 };
+	//spotlight:
+	constexpr Quantizer SpotlightPos{ -32.0f, 32.0f, 16 };
+	constexpr Quantizer SpotlightDir{ -1.0f, 1.0f, 16 }; //unit vector components
+	constexpr Quantizer SpotlightEnergy{ 0.0f, 128.0f, 16 };
+	constexpr Quantizer SpotlightCutoff{ 0.0f, 3.1415927f, 16 };
+	//timer counts down from 60 seconds:
+	constexpr Quantizer Timer{ 0.0f, 64.0f, 16 };
+
+	//round-trip error bounds the client can rely on:
+	static_assert(PositionX.max_error() < 0.001f && PositionY.max_error() < 0.001f, "positions should round-trip within a millimeter");
+	static_assert(Velocity.max_error() < 0.001f, "velocities should round-trip within 1mm/s");
+	static_assert(Color.max_error() < 0.5f / 255.0f + 1e-6f, "colors should round-trip within 8-bit precision");
+	static_assert(SpotlightDir.max_error() < 0.0001f, "spotlight direction should round-trip within 1e-4");
+	static_assert(SpotlightCutoff.max_error() < 0.0001f, "spotlight cutoff should round-trip within 1e-4 radians");
+	static_assert(Timer.max_error() < 0.001f, "timer should round-trip within a millisecond");
+}
@@ -0,0 +1,42 @@
+#include "IdPool.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cassert>
+
+IdPool::Id IdPool::allocate() {
+	uint32_t index;
+	if (free_indices.size() > MinFree || (!free_indices.empty() && generations.size() >= IndexMask)) {
+		index = free_indices.front();
+		free_indices.pop_front();
+	} else if (generations.size() < IndexMask) {
+		index = uint32_t(generations.size());
+		generations.emplace_back(0);
+		live.emplace_back(0);
+	} else {
+		throw std::runtime_error("Ran out of ids (" + std::to_string(IndexMask) + " in use).");
+	}
+	assert(!live[index]);
+	live[index] = 1;
+	return make_id(index, generations[index]);
+}
+
+void IdPool::release(Id id) {
+	assert(is_live(id));
+	uint32_t index = index_of(id);
+	live[index] = 0;
+	generations[index] = (generations[index] + 1) & GenerationMask;
+	//(index IndexMask is never handed out, so no id ever equals InvalidId)
+	free_indices.emplace_back(index);
+}
+
+bool IdPool::is_live(Id id) const {
+	uint32_t index = index_of(id);
+	return index < generations.size() && live[index] && generations[index] == generation_of(id);
+}
+
+void IdPool::clear() {
+	generations.clear();
+	live.clear();
+	free_indices.clear();
+}
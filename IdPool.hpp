@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+//Hands out generational ids: the low IndexBits bits are an index (reused once freed),
+// and the high bits count how many times that index has been handed out.
+//
+// Freed indices wait in a queue until at least MinFree others have been freed, and every reuse
+// bumps the generation, so an old id (say, in a late network message) won't name a new owner.
+struct IdPool {
+	using Id = uint32_t;
+
+	inline static constexpr uint32_t IndexBits = 20; //up to ~1M ids in use at once
+	inline static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+	inline static constexpr uint32_t GenerationMask = (~0u) >> IndexBits;
+	inline static constexpr uint32_t MinFree = 1024;
+	inline static constexpr Id InvalidId = ~0u; //(never handed out)
+
+	static uint32_t index_of(Id id) { return id & IndexMask; }
+	static uint32_t generation_of(Id id) { return id >> IndexBits; }
+	static Id make_id(uint32_t index, uint32_t generation) { return (generation << IndexBits) | index; }
+
+	//get an unused id (throws if all indices are in use):
+	Id allocate();
+	//return an id to the pool:
+	void release(Id id);
+	//is 'id' currently allocated?
+	bool is_live(Id id) const;
+	//forget all ids (generations restart):
+	void clear();
+
+	//number of ids currently allocated:
+	uint32_t live_count() const { return uint32_t(generations.size() - free_indices.size()); }
+	//every index handed out so far is less than this:
+	uint32_t index_limit() const { return uint32_t(generations.size()); }
+
+	//internals:
+	std::vector< uint32_t > generations; //current generation of each index (incremented on release)
+	std::vector< uint8_t > live; //is each index allocated?
+	std::deque< uint32_t > free_indices; //released indices, oldest first
+};
@@ -0,0 +1,141 @@
+#include "Interest.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	//is 'point' within 'margin' of the cone with apex 'apex', axis 'dir', and half-angle 'cutoff'?
+	bool near_cone(glm::vec3 apex, glm::vec3 dir, float cutoff, float margin, glm::vec3 point) {
+		if (glm::length(dir) == 0.0f) return false; //(spotlight not aimed yet)
+		dir = glm::normalize(dir);
+		glm::vec3 to = point - apex;
+		float along = glm::dot(to, dir);
+		if (along <= 0.0f) return glm::length(to) <= margin;
+		float radial = glm::length(to - along * dir);
+		//(distance to the cone's surface, measured perpendicular to it)
+		return radial * std::cos(cutoff) - along * std::sin(cutoff) <= margin;
+	}
+}
+
+Interest::Interest(Settings const &settings_) : settings(settings_) {
+}
+
+bool Interest::lit_for_seeker(Game const &game, glm::vec2 seeker, glm::vec2 at) const {
+	glm::vec3 ground = glm::vec3(at, 0.0f);
+
+	//the light PlayMode hangs above the seeker:
+	glm::vec3 above = glm::vec3(seeker, settings.seeker_light_height);
+	if (near_cone(above, glm::vec3(0.0f, 0.0f, -1.0f), settings.seeker_light_cutoff, settings.margin, ground)) return true;
+
+	//the game's spotlight:
+	if (near_cone(game.spotlight.pos, game.spotlight.dir, game.spotlight.cutoff, settings.margin, ground)) return true;
+
+	return false;
+}
+
+void Interest::decide(Game const &game, uint32_t viewer, Game::View const *baseline_view) {
+	PlayerStore const &players = game.players;
+
+	//baseline row of each player the client has:
+	uint32_t index_limit = 0;
+	for (Player::Id id : players.player_id) {
+		index_limit = std::max(index_limit, IdPool::index_of(id) + 1);
+	}
+	base_index.assign(index_limit, PlayerStore::InvalidIndex);
+	if (baseline_view) {
+		for (uint32_t r = 0; r < baseline_view->size(); ++r) {
+			uint32_t index = IdPool::index_of((*baseline_view)[r].id);
+			if (index < index_limit) base_index[index] = r;
+		}
+	}
+	if (priorities.size() < index_limit) priorities.resize(index_limit);
+
+	bool playing = (game.game_state == Game::GameState::Playing);
+	bool has_viewer = (viewer != PlayerStore::InvalidIndex);
+	bool seeker_view = playing && has_viewer && players.role[viewer] == Player::Role::Seeker;
+
+	relevance.assign(players.size(), Game::Relevance::Update);
+	candidates.clear();
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		Player::Id id = players.player_id[i];
+		Priority &p = priorities[IdPool::index_of(id)];
+		if (p.id != id) p = Priority{ id, 0.0f }; //(new player in this slot)
+
+		if (i == viewer) continue;
+
+		if (seeker_view && players.role[i] == Player::Role::Hider && !players.is_caught[i]
+		 && !lit_for_seeker(game, players.position[viewer], players.position[i])) {
+			relevance[i] = Game::Relevance::Hidden;
+			p.priority = 0.0f;
+			continue;
+		}
+
+		uint32_t b = base_index[IdPool::index_of(id)];
+		if (b == PlayerStore::InvalidIndex || (*baseline_view)[b].id != id) continue; //(client doesn't have it: send now)
+		if (game.tick - (*baseline_view)[b].tick >= settings.max_stale) continue; //(deferred long enough)
+
+		float rate = 1.0f;
+		if (playing && has_viewer) {
+			float distance = glm::length(players.position[i] - players.position[viewer]);
+			if (distance > settings.near) rate = std::max(settings.min_rate, settings.near / distance);
+		}
+		p.priority += rate;
+		relevance[i] = Game::Relevance::Defer;
+		if (p.priority >= 1.0f) candidates.emplace_back(i);
+	}
+
+	//send the highest-priority deferrable players, up to the budget:
+	if (settings.budget != 0 && candidates.size() > settings.budget) {
+		auto priority_of = [&](uint32_t i) { return priorities[IdPool::index_of(players.player_id[i])].priority; };
+		std::partial_sort(candidates.begin(), candidates.begin() + settings.budget, candidates.end(), [&](uint32_t a, uint32_t b) {
+			return priority_of(a) > priority_of(b);
+		});
+		candidates.resize(settings.budget);
+	}
+	for (uint32_t i : candidates) {
+		relevance[i] = Game::Relevance::Update;
+	}
+
+	for (uint32_t i = 0; i < players.size(); ++i) {
+		Priority &p = priorities[IdPool::index_of(players.player_id[i])];
+		if (relevance[i] == Game::Relevance::Update) {
+			//(players sent early, e.g. for being stale, start over)
+			p.priority = (p.priority >= 1.0f ? p.priority - 1.0f : 0.0f);
+			updates += 1;
+		} else if (relevance[i] == Game::Relevance::Defer) {
+			deferred += 1;
+		} else {
+			hidden += 1;
+		}
+	}
+}
+
+std::shared_ptr< std::vector< uint8_t > const > Interest::encode_state(Game const &game, PlayerStore::Handle player, StateAck const *ack) {
+	//find the view the client acknowledged (only usable if every snapshot it refers to is still in history):
+	Game::Snapshot const *baseline = nullptr;
+	Game::View const *baseline_view = nullptr;
+	if (ack) {
+		Sent const &acked = sent[ack->tick % Game::SnapshotHistory];
+		baseline = game.find_snapshot(ack->tick);
+		if (baseline && acked.valid && acked.tick == ack->tick) {
+			baseline_view = &acked.view;
+			for (Game::ViewRow const &row : acked.view) {
+				if (!game.find_snapshot(row.tick)) {
+					baseline_view = nullptr;
+					break;
+				}
+			}
+		}
+		if (!baseline_view) baseline = nullptr;
+	}
+
+	uint32_t viewer = (player != PlayerStore::InvalidHandle ? game.players.index(player) : PlayerStore::InvalidIndex);
+	decide(game, viewer, baseline_view);
+
+	Sent &next = sent[game.tick % Game::SnapshotHistory];
+	next.tick = game.tick;
+	next.valid = true;
+	static Game::View const empty_view;
+	return game.encode_state(baseline, baseline_view ? *baseline_view : empty_view, relevance, &next.view);
+}
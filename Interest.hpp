@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Game.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//Server-side interest management: each client is sent only the players relevant to it, and far-away ones less often.
+//
+// - During a match, the seeker only hears about hiders it could see: ones inside its own light (the spot PlayMode hangs
+//   above it), inside the game's Spotlight, or (caught) out of play. Cones are widened by 'margin' so a hider arrives a
+//   little before it steps into the light. Everyone else, and everyone outside a match, hears about every player.
+// - Each relevant player has a priority that grows every tick by its rate: 1 within 'near' of the recipient, falling off
+//   as near / distance beyond that (but not below 'min_rate'). Players whose priority reaches 1 get their motion sent
+//   (at most 'budget' per message, highest priority first); the rest are deferred and the client keeps the position it has.
+// - The recipient's own player, players the client doesn't have yet, and changes other than motion (role, ready,
+//   caught, ...) always go out right away, and no player is deferred for more than 'max_stale' ticks.
+//
+// Since every client now has its own subset of the players, deltas can't be shared between clients any more:
+// each client's messages are encoded against the view the server remembers sending it at the acknowledged tick.
+
+struct Interest {
+	struct Settings {
+		bool enabled = true;
+		//distance (world units) within which relevant players are updated every tick:
+		float near = 5.0f;
+		//slowest update rate (fraction of ticks) for far-away players:
+		float min_rate = 0.25f;
+		//most deferrable players updated per message (0: no limit):
+		uint32_t budget = 0;
+		//most ticks a player's motion can be deferred:
+		// (views refer to snapshots this old, so keep it well under Game::SnapshotHistory)
+		uint32_t max_stale = 8;
+		//widen light cones by this much (a player's radius, plus how far it moves in a quarter second):
+		float margin = Game::PlayerRadius + 0.25f * Game::PlayerSpeed;
+		//the light above the seeker (as drawn by PlayMode: 10 units up, pointing down; cutoff from the
+		// spot light in dist/hide-and-seek.scene, which PlayMode uses as the cone's half-angle):
+		float seeker_light_height = 10.0f;
+		float seeker_light_cutoff = 15.0f / 180.0f * 3.1415926f;
+	};
+
+	explicit Interest(Settings const &settings);
+	Settings settings;
+
+	//encode this tick's state message for the client controlling 'player' (or no one, if InvalidHandle),
+	// relative to the state it acknowledged ('ack', or nullptr if it hasn't acknowledged one yet):
+	// (call after game.record_snapshot() for the current tick)
+	std::shared_ptr< std::vector< uint8_t > const > encode_state(Game const &game, PlayerStore::Handle player, StateAck const *ack);
+
+	//what to send about each player this tick (fills 'relevance'; 'baseline_view' may be nullptr for a full state):
+	void decide(Game const &game, uint32_t viewer, Game::View const *baseline_view);
+
+	//could the seeker standing at 'seeker' see something at 'at'?
+	bool lit_for_seeker(Game const &game, glm::vec2 seeker, glm::vec2 at) const;
+
+	//internals:
+	//view after each message sent, by tick % Game::SnapshotHistory:
+	struct Sent {
+		uint32_t tick = 0;
+		bool valid = false;
+		Game::View view;
+	};
+	std::array< Sent, Game::SnapshotHistory > sent;
+
+	//priority of each player, by IdPool::index_of(player id):
+	struct Priority {
+		Player::Id id = IdPool::InvalidId;
+		float priority = 0.0f;
+	};
+	std::vector< Priority > priorities;
+
+	//scratch (kept to avoid reallocating every tick):
+	std::vector< Game::Relevance > relevance;
+	std::vector< uint32_t > base_index; //baseline view row of each player, by IdPool::index_of(player id)
+	std::vector< uint32_t > candidates;
+
+	//stats (since creation):
+	uint64_t updates = 0; //players sent (or kept current) in messages
+	uint64_t deferred = 0; //players left as the client had them
+	uint64_t hidden = 0; //players left out
+};
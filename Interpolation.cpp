@@ -0,0 +1,86 @@
+#include "Interpolation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//when state messages arrive later than the fastest one so far, move the clock offset this fraction of the way toward them
+// (so one lucky fast message, or the server dropping ticks, doesn't leave the offset wrong forever):
+static constexpr double OffsetRecovery = 0.01;
+
+Interpolation::Interpolation(float delay_) : delay(delay_) {
+}
+
+void Interpolation::on_state(uint32_t tick, double now) {
+	double sample = now - double(tick) * double(Game::Tick);
+	if (!has_offset || sample < offset) {
+		offset = sample;
+		has_offset = true;
+	} else {
+		offset += (sample - offset) * OffsetRecovery;
+	}
+}
+
+void Interpolation::begin_frame(Game const &game, double now) {
+	from = nullptr;
+	to = nullptr;
+	amt = 0.0f;
+	if (!has_offset) return;
+
+	//render time, in (fractional) ticks:
+	double render = (now - offset - double(delay)) / double(Game::Tick);
+	if (render < 0.0) render = 0.0;
+	int64_t base = int64_t(std::floor(render));
+
+	//closest recorded snapshots on either side of the render time:
+	for (int64_t t = base; t >= 0 && t > base - int64_t(Game::SnapshotHistory); --t) {
+		if ((from = game.find_snapshot(uint32_t(t)))) break;
+	}
+	for (int64_t t = base + 1; t <= base + int64_t(Game::SnapshotHistory); ++t) {
+		if ((to = game.find_snapshot(uint32_t(t)))) break;
+	}
+
+	if (from && to) {
+		amt = float((render - double(from->tick)) / double(to->tick - from->tick));
+		amt = std::clamp(amt, 0.0f, 1.0f);
+	} else if (to) {
+		//render time is older than anything recorded (e.g., just connected): hold at the oldest snapshot:
+		from = to;
+		to = nullptr;
+	}
+	//(otherwise, render time is past the newest snapshot, so hold at 'from' until the next one arrives)
+
+	auto build_index = [](Game::Snapshot const *snapshot, std::vector< uint32_t > *index_) {
+		auto &index = *index_;
+		index.clear();
+		if (!snapshot) return;
+		PlayerStore const &players = snapshot->players;
+		for (uint32_t i = 0; i < players.size(); ++i) {
+			uint32_t slot = IdPool::index_of(players.player_id[i]);
+			if (slot >= index.size()) index.resize(slot + 1, PlayerStore::InvalidIndex);
+			index[slot] = i;
+		}
+	};
+	build_index(from, &from_index);
+	build_index(to, &to_index);
+}
+
+glm::vec2 Interpolation::position(Player::Id id, glm::vec2 current) const {
+	auto find = [id](Game::Snapshot const *snapshot, std::vector< uint32_t > const &index) {
+		if (!snapshot) return PlayerStore::InvalidIndex;
+		uint32_t slot = IdPool::index_of(id);
+		if (slot >= index.size()) return PlayerStore::InvalidIndex;
+		uint32_t i = index[slot];
+		if (i == PlayerStore::InvalidIndex || snapshot->players.player_id[i] != id) return PlayerStore::InvalidIndex;
+		return i;
+	};
+
+	uint32_t a = find(from, from_index);
+	if (a == PlayerStore::InvalidIndex) return current;
+	glm::vec2 position = from->players.position[a];
+
+	uint32_t b = find(to, to_index);
+	if (b != PlayerStore::InvalidIndex) {
+		position = glm::mix(position, to->players.position[b], amt);
+	}
+	return position;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Game.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//Client-side smoothing of other players' motion:
+// state messages are timestamped with their server time (tick * Game::Tick), and players are drawn 'delay'
+// seconds behind the newest server time, interpolated between the two recorded snapshots (Game::history) around it.
+// So motion stays smooth through network jitter (and lower server tick rates) at the cost of 'delay' extra latency.
+
+struct Interpolation {
+	explicit Interpolation(float delay = 0.1f);
+
+	//how far behind the newest server state to draw (seconds; keep at least a tick or two plus expected jitter):
+	float delay;
+
+	//call for every state message decoded, with the local time (seconds) it arrived:
+	void on_state(uint32_t tick, double now);
+
+	//pick the snapshots to draw from at local time 'now' (once per frame, before position()):
+	void begin_frame(Game const &game, double now);
+
+	//where to draw the player with id 'id' this frame (or 'current' if it isn't in the snapshots):
+	glm::vec2 position(Player::Id id, glm::vec2 current) const;
+
+	//internals:
+	bool has_offset = false;
+	double offset = 0.0; //local time minus server time, for (about) the fastest recent state message
+
+	Game::Snapshot const *from = nullptr; //latest snapshot at or before the render time
+	Game::Snapshot const *to = nullptr; //next snapshot after it (nullptr if it hasn't arrived)
+	float amt = 0.0f; //how far from 'from' to 'to'
+
+	//player index in 'from' and 'to', by IdPool::index_of(id) (PlayerStore::InvalidIndex if absent):
+	std::vector< uint32_t > from_index, to_index;
+};
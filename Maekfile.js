@@ -152,19 +152,32 @@ if (maek.OS === 'windows') {
 const client_names = [
 	maek.CPP('client.cpp'),
 	maek.CPP('PlayMode.cpp'),
+	maek.CPP('Interpolation.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
-	maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
+	maek.CPP('ColorTextureProgram.cpp')  //not used right now, but you might want it
+];
+
+//(the mixing kernels are used by Sound.cpp, and on their own by bench-mix)
+const sound_mix_object = maek.CPP('sound_mix.cpp');
+
+const sound_names = [
 	maek.CPP('Sound.cpp'),
 	maek.CPP('load_wav.cpp'),
-	maek.CPP('load_opus.cpp')
+	maek.CPP('load_opus.cpp'),
+	sound_mix_object
 ];
 
 const server_names = [
-	maek.CPP('server.cpp')
+	maek.CPP('server.cpp'),
+	maek.CPP('RoomManager.cpp'),
+	maek.CPP('Interest.cpp'),
+	maek.CPP('TickScheduler.cpp')
 ];
 
 const common_names = [
 	maek.CPP('Game.cpp'),
+	maek.CPP('SpatialHash.cpp'),
+	maek.CPP('IdPool.cpp'),
 	maek.CPP('data_path.cpp'),
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
@@ -178,6 +191,8 @@ const common_names = [
 	maek.CPP('GL.cpp'),
 	maek.CPP('Load.cpp'),
 	maek.CPP('Connection.cpp'),
+	maek.CPP('Datagram.cpp'),
+	maek.CPP('NetSim.cpp'),
 	maek.CPP('hex_dump.cpp'),
 	maek.CPP('GlyphCache.cpp')
 ];
@@ -188,6 +203,38 @@ const show_meshes_names = [
 	maek.CPP('ShowMeshesMode.cpp')
 ];
 
+const bench_collision_names = [
+	maek.CPP('bench-collision.cpp')
+];
+
+const check_ids_names = [
+	maek.CPP('check-ids.cpp')
+];
+
+const check_state_encoding_names = [
+	maek.CPP('check-state-encoding.cpp')
+];
+
+const bench_state_decode_names = [
+	maek.CPP('bench-state-decode.cpp')
+];
+
+const bench_mix_names = [
+	maek.CPP('bench-mix.cpp')
+];
+
+const bench_sound_names = [
+	maek.CPP('bench-sound.cpp')
+];
+
+const loadbot_names = [
+	maek.CPP('loadbot.cpp')
+];
+
+const datagram_harness_names = [
+	maek.CPP('datagram-harness.cpp')
+];
+
 const show_scene_names = [
 	maek.CPP('show-scene.cpp'),
 	maek.CPP('ShowSceneProgram.cpp'),
@@ -198,13 +245,21 @@ const show_scene_names = [
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const client_exe = maek.LINK([...client_names, ...common_names], 'dist/client');
+const client_exe = maek.LINK([...client_names, ...sound_names, ...common_names], 'dist/client');
 const server_exe = maek.LINK([...server_names, ...common_names], 'dist/server');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const bench_collision_exe = maek.LINK([...bench_collision_names, ...common_names], 'dist/bench-collision');
+const check_ids_exe = maek.LINK([...check_ids_names, ...common_names], 'dist/check-ids');
+const check_state_encoding_exe = maek.LINK([...check_state_encoding_names, ...common_names], 'dist/check-state-encoding');
+const bench_state_decode_exe = maek.LINK([...bench_state_decode_names, ...common_names], 'dist/bench-state-decode');
+const bench_mix_exe = maek.LINK([...bench_mix_names, sound_mix_object, ...common_names], 'dist/bench-mix');
+const bench_sound_exe = maek.LINK([...bench_sound_names, ...sound_names, ...common_names], 'dist/bench-sound');
+const loadbot_exe = maek.LINK([...loadbot_names, ...common_names], 'dist/loadbot');
+const datagram_harness_exe = maek.LINK([...datagram_harness_names, ...common_names], 'dist/datagram-harness');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [client_exe, server_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [client_exe, server_exe, show_meshes_exe, show_scene_exe, bench_collision_exe, check_ids_exe, check_state_encoding_exe, bench_state_decode_exe, bench_mix_exe, bench_sound_exe, loadbot_exe, datagram_harness_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
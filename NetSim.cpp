@@ -0,0 +1,133 @@
+#include "NetSim.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+//shape of the pareto jitter distribution (2 gives a finite mean and a long tail):
+static constexpr double ParetoShape = 2.0;
+
+//reordered datagrams are held back at least this long (seconds):
+static constexpr double MinReorderHold = 0.01;
+
+bool NetSim::Settings::enabled() const {
+	return delay > 0.0 || jitter > 0.0 || loss > 0.0 || reorder > 0.0 || rate > 0.0;
+}
+
+NetSim::Settings NetSim::Settings::parse(std::string const &spec) {
+	Settings settings;
+	std::istringstream in(spec);
+	std::string item;
+	while (std::getline(in, item, ',')) {
+		if (item.empty()) continue;
+		auto eq = item.find('=');
+		if (eq == std::string::npos) throw std::runtime_error("netsim: expected key=value, got '" + item + "'");
+		std::string key = item.substr(0, eq);
+		std::string value = item.substr(eq + 1);
+
+		if (key == "dist") {
+			if (value == "uniform") settings.distribution = Distribution::Uniform;
+			else if (value == "normal") settings.distribution = Distribution::Normal;
+			else if (value == "pareto") settings.distribution = Distribution::Pareto;
+			else throw std::runtime_error("netsim: unknown distribution '" + value + "' (expecting uniform, normal, or pareto)");
+			continue;
+		}
+
+		double number;
+		try {
+			size_t used = 0;
+			number = std::stod(value, &used);
+			if (used != value.size()) throw std::invalid_argument(value);
+		} catch (std::exception const &) {
+			throw std::runtime_error("netsim: expected a number for '" + key + "', got '" + value + "'");
+		}
+		if (!(number >= 0.0)) throw std::runtime_error("netsim: '" + key + "' can't be negative");
+
+		if (key == "delay") settings.delay = number / 1000.0;
+		else if (key == "jitter") settings.jitter = number / 1000.0;
+		else if (key == "loss") settings.loss = std::min(1.0, number / 100.0);
+		else if (key == "reorder") settings.reorder = std::min(1.0, number / 100.0);
+		else if (key == "rate") settings.rate = number * 1024.0;
+		else if (key == "queue") settings.queue = number * 1024.0;
+		else if (key == "seed") settings.seed = uint32_t(number);
+		else throw std::runtime_error("netsim: unknown setting '" + key + "'");
+	}
+	return settings;
+}
+
+std::string NetSim::Settings::to_string() const {
+	std::ostringstream out;
+	out << "delay=" << delay * 1000.0 << ",jitter=" << jitter * 1000.0
+	    << ",dist=" << (distribution == Distribution::Uniform ? "uniform" : distribution == Distribution::Normal ? "normal" : "pareto")
+	    << ",loss=" << loss * 100.0 << ",reorder=" << reorder * 100.0
+	    << ",rate=" << rate / 1024.0 << ",queue=" << queue / 1024.0;
+	if (seed != 0) out << ",seed=" << seed;
+	return out.str();
+}
+
+NetSim::NetSim(Settings const &settings_, bool datagrams_) : settings(settings_), datagrams(datagrams_), mt(settings_.seed ? settings_.seed : std::random_device()()) {
+}
+
+void NetSim::push(void const *data, size_t size, Clock::time_point now) {
+	std::uniform_real_distribution< double > unit(0.0, 1.0);
+	auto seconds = [](double s) {
+		return std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(s));
+	};
+
+	//bandwidth: data waits for everything ahead of it, then takes size / rate to send:
+	Clock::time_point sent = now;
+	if (settings.rate > 0.0) {
+		Clock::time_point start = std::max(now, link_free);
+		if (datagrams && std::chrono::duration< double >(start - now).count() * settings.rate > settings.queue) {
+			dropped += 1; //(tail drop, like a full router queue)
+			return;
+		}
+		sent = start + seconds(double(size) / settings.rate);
+		link_free = sent;
+	}
+
+	if (datagrams && settings.loss > 0.0 && unit(mt) < settings.loss) {
+		dropped += 1;
+		return;
+	}
+
+	double extra = 0.0;
+	if (settings.jitter > 0.0) {
+		if (settings.distribution == Distribution::Uniform) {
+			extra = settings.jitter * unit(mt);
+		} else if (settings.distribution == Distribution::Normal) {
+			extra = std::abs(std::normal_distribution< double >(0.0, settings.jitter)(mt));
+		} else {
+			//pareto with minimum m has mean m * shape / (shape - 1); shift it to start at zero with mean 'jitter':
+			double m = settings.jitter * (ParetoShape - 1.0);
+			extra = m * (std::pow(1.0 - unit(mt), -1.0 / ParetoShape) - 1.0);
+		}
+	}
+	if (datagrams && settings.reorder > 0.0 && unit(mt) < settings.reorder) {
+		extra += std::max(MinReorderHold, settings.delay + settings.jitter);
+		reordered += 1;
+	}
+
+	Clock::time_point release = sent + seconds(settings.delay + extra);
+	if (!datagrams) {
+		release = std::max(release, last_release);
+		last_release = release;
+	}
+
+	uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+	held.emplace(release, std::vector< uint8_t >(bytes, bytes + size));
+}
+
+bool NetSim::pop(Clock::time_point now, std::vector< uint8_t > *data) {
+	if (held.empty() || held.begin()->first > now) return false;
+	*data = std::move(held.begin()->second);
+	held.erase(held.begin());
+	bytes_delivered += data->size();
+	return true;
+}
+
+NetSim::Clock::time_point NetSim::next_release() const {
+	if (held.empty()) return Clock::time_point::max();
+	return held.begin()->first;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+//In-process network condition simulator ("netsim"):
+// when a Server or Client has netsim settings, every connection's outgoing data passes through one emulated
+// link on its way to the socket, and incoming data through another on its way to recv_buffer (see Connection.cpp).
+// The links add delay (a fixed part plus random jitter), limit bandwidth, and -- for UDP packets only,
+// since a TCP stream has to arrive intact and in order -- drop and reorder.
+//
+// Each side applies the settings to what it sends and to what it receives, so enabling netsim on just the
+// client (or just the server) is enough to emulate a whole path; e.g., 'delay=40' adds 80ms to the round trip.
+//
+// Settings are written as comma-separated key=value pairs, e.g. "delay=40,jitter=10,dist=pareto,loss=2,rate=64":
+//   delay=MS        fixed one-way delay
+//   jitter=MS       random extra delay (scale of 'dist')
+//   dist=uniform|normal|pareto
+//                   uniform: [0,jitter); normal: |N(0,jitter)|; pareto: heavy tailed, mean jitter
+//   loss=PERCENT    UDP packets dropped
+//   reorder=PERCENT UDP packets held back (by delay + jitter, at least 10ms) so later ones overtake them
+//   rate=KB/S       bandwidth (0: unlimited); data queues behind what's already being sent
+//   queue=KB        most data waiting for bandwidth before UDP packets are dropped (default 64)
+//   seed=N          random seed (0, the default: different every run)
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct NetSim {
+	using Clock = std::chrono::steady_clock;
+
+	enum class Distribution : uint8_t {
+		Uniform,
+		Normal,
+		Pareto,
+	};
+
+	struct Settings {
+		double delay = 0.0; //seconds
+		double jitter = 0.0; //seconds
+		Distribution distribution = Distribution::Uniform;
+		double loss = 0.0; //fraction
+		double reorder = 0.0; //fraction
+		double rate = 0.0; //bytes per second
+		double queue = 64.0 * 1024.0; //bytes
+		uint32_t seed = 0;
+
+		//does this change anything? (if not, connections skip the simulator entirely)
+		bool enabled() const;
+
+		//parse the format above (throws std::runtime_error on anything unrecognized):
+		static Settings parse(std::string const &spec);
+		//...and print it back:
+		std::string to_string() const;
+	};
+
+	//one direction of a link; 'datagrams' allows loss and reordering, otherwise bytes come out in the order they went in:
+	NetSim(Settings const &settings, bool datagrams);
+
+	//data entering the link at time 'now' (a datagram, or more of the stream):
+	void push(void const *data, size_t size, Clock::time_point now);
+
+	//next data to leave the link by time 'now' (returns false if none is due yet):
+	bool pop(Clock::time_point now, std::vector< uint8_t > *data);
+
+	//when the next data is due to leave (Clock::time_point::max() if the link is empty):
+	Clock::time_point next_release() const;
+	bool empty() const { return held.empty(); }
+
+	Settings settings;
+	bool datagrams;
+	std::mt19937 mt;
+
+	//internals:
+	std::multimap< Clock::time_point, std::vector< uint8_t > > held; //by release time (in push order for equal times)
+	Clock::time_point link_free; //when the bandwidth-limited link finishes sending what's already queued
+	Clock::time_point last_release; //(streams) latest release time so far, so nothing overtakes
+
+	//stats:
+	uint64_t bytes_delivered = 0;
+	uint64_t dropped = 0; //datagrams lost (at random or to a full queue)
+	uint64_t reordered = 0; //datagrams held back
+};
@@ -150,7 +150,7 @@ void PlayMode::draw_text(const std::string& text, float origin_x, float baseline
 	glUseProgram(0);
 }
 
-PlayMode::PlayMode(Client &client_) : client(client_), scene(*game_scene) {
+PlayMode::PlayMode(Client &client_, float interpolation_delay) : interpolation(interpolation_delay), client(client_), scene(*game_scene) {
 	
 
 	dynamic_scene = scene;
@@ -234,9 +234,20 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	clock += elapsed;
+
+	//queue data for sending to server (only if something changed, or to keep in touch):
+	controls_heartbeat -= elapsed;
+	if (controls.changed_since(sent_controls) || controls_heartbeat <= 0.0f) {
+		controls_sequence += 1;
+		controls.send_controls_message(&client.connection, controls_sequence);
+		sent_controls = controls;
+		controls_heartbeat = Game::ControlsHeartbeat;
+	}
 
-	//queue data for sending to server:
-	controls.send_controls_message(&client.connection);
+	//remember them until the server has simulated them (for prediction):
+	unapplied_controls.emplace_back(HeldControls{ controls_sequence, controls, elapsed });
+	if (unapplied_controls.size() > 256) unapplied_controls.pop_front(); //(server isn't keeping up; don't grow forever)
 
 	//reset button press counters:
 	controls.left.downs = 0;
@@ -246,20 +257,29 @@ void PlayMode::update(float elapsed) {
 	controls.jump.downs = 0;
 
 	//send/receive data:
-	client.poll([this](Connection *c, Connection::Event event){
+	bool got_state = false;
+	client.poll([this,&got_state](Connection *c, Connection::Event event){
 		if (event == Connection::OnOpen) {
 			std::cout << "[" << c->socket << "] opened" << std::endl;
 		} else if (event == Connection::OnClose) {
 			std::cout << "[" << c->socket << "] closed (!)" << std::endl;
 			throw std::runtime_error("Lost connection to server!");
 		} else { assert(event == Connection::OnRecv);
-			//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
+			//std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer.data(), c->recv_buffer.size()); std::cout.flush(); //DEBUG
 			bool handled_message;
+			bool got_state_now = false;
 			try {
 				do {
 					handled_message = false;
-					if (game.recv_state_message(c)) handled_message = true;
+					if (game.recv_state_message(c)) {
+						handled_message = true;
+						got_state_now = true;
+						interpolation.on_state(game.tick, clock);
+					}
 				} while (handled_message);
+				//let the server know which state we have, so it can send only changes against it:
+				if (got_state_now) StateAck{ game.tick }.send_ack_message(c);
+				got_state = got_state || got_state_now;
 			} catch (std::exception const &e) {
 				std::cerr << "[" << c->socket << "] malformed message from server: " << e.what() << std::endl;
 				//quit the game:
@@ -268,47 +288,110 @@ void PlayMode::update(float elapsed) {
 		}
 	}, 0.0);
 
-	
-	for (auto &p : game.players) {
+	//predict the local player:
+	uint32_t local = game.local_player();
+	if (local == PlayerStore::InvalidIndex || game.players.is_caught[local]
+	 || game.game_state == Game::GameState::SeekerWin || game.game_state == Game::GameState::HiderWin) {
+		//(nothing to predict: the server isn't moving this player)
+		has_prediction = false;
+	} else {
+		Player::Role role = game.players.role[local];
+		auto step = [&](Player::Controls const &step_controls, float step_elapsed) {
+			//same movement as Game::update (but without player/player collisions, which the server corrects):
+			Game::Movement movement(step_elapsed);
+			predicted_velocity = movement.steer(predicted_velocity, step_controls);
+			predicted_position = movement.advance(predicted_position, predicted_velocity, role);
+			Game::Movement::clamp_to_arena(&predicted_position, &predicted_velocity);
+		};
+		if (got_state || !has_prediction) {
+			//reconcile: start from the server's state and replay the controls it hasn't simulated yet:
+			uint32_t applied = game.local_controls_sequence;
+			while (!unapplied_controls.empty() && int32_t(unapplied_controls.front().sequence - applied) < 0) {
+				unapplied_controls.pop_front();
+			}
+			//(the server has already simulated this long with the latest controls it applied)
+			float simulated = float(game.local_controls_ticks) * Game::Tick;
+
+			predicted_position = game.players.position[local];
+			predicted_velocity = game.players.velocity[local];
+			for (HeldControls const &held : unapplied_controls) {
+				float held_elapsed = held.elapsed;
+				if (held.sequence == applied) {
+					float skip = std::min(simulated, held_elapsed);
+					simulated -= skip;
+					held_elapsed -= skip;
+				}
+				if (held_elapsed > 0.0f) step(held.controls, held_elapsed);
+			}
+			has_prediction = true;
+		} else {
+			//no news from the server: just move by this frame's controls:
+			step(controls, elapsed);
+		}
+	}
+
+	//pick the server states to draw other players from:
+	interpolation.begin_frame(game, clock);
+
+	for (uint32_t i = 0; i < game.players.size(); ++i) {
+		Player::Id player_id = game.players.player_id[i];
 		
-		if (player_to_drawable.count(p.player_id) == 0) {
+		if (player_to_drawable.count(player_id) == 0) {
 			std::list<Scene::Drawable>::iterator it_src;
-			if (p.role == Player::Role::Seeker) {
+			if (game.players.role[i] == Player::Role::Seeker) {
 				it_src = std::next(scene.drawables.begin(), 1);
 			}
-			else if (p.role == Player::Role::Hider){
+			else if (game.players.role[i] == Player::Role::Hider){
 				it_src = std::next(scene.drawables.begin(), 2);			
 			}
 
 			auto it_dst = create_drawable(dynamic_scene, it_src);
-			player_to_drawable[p.player_id] = it_dst;
+			player_to_drawable[player_id] = it_dst;
 		}
 		
-		if (p.is_caught) {
-			if (player_to_drawable.count(p.player_id) == 1) {
-				delete_drawable(dynamic_scene, player_to_drawable[p.player_id]);
-				player_to_drawable.erase(p.player_id);
+		if (game.players.is_caught[i]) {
+			if (player_to_drawable.count(player_id) == 1) {
+				delete_drawable(dynamic_scene, player_to_drawable[player_id]);
+				player_to_drawable.erase(player_id);
 			}
 		}
 
 	}
 
-	for (auto &p : game.players) {
-		if (p.is_caught) continue;
+	//remove players that are no longer in the state (they left, or the server stopped sending them, e.g. hiders out of the seeker's sight):
+	for (auto it = player_to_drawable.begin(); it != player_to_drawable.end(); ) {
+		if (game.players.find_id(it->first) == PlayerStore::InvalidIndex) {
+			delete_drawable(dynamic_scene, it->second);
+			it = player_to_drawable.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	for (uint32_t i = 0; i < game.players.size(); ++i) {
+		if (game.players.is_caught[i]) continue;
 		
-		player_to_drawable[p.player_id]->transform->position = glm::vec3(p.position.x, p.position.y, 0.05f);
+		glm::vec2 position;
+		if (i == local && has_prediction) position = predicted_position;
+		else position = interpolation.position(game.players.player_id[i], game.players.position[i]);
+		player_to_drawable[game.players.player_id[i]]->transform->set_position(glm::vec3(position.x, position.y, 0.05f));
 	}
 
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
-	bool is_seeker = game.players.front().role == Player::Role::Seeker;
+	uint32_t local = game.local_player();
+	bool has_local = (local != PlayerStore::InvalidIndex);
+	bool is_seeker = has_local && game.players.role[local] == Player::Role::Seeker;
 	float cut_off_cos = 0.0f;
 
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
+	//refresh the world matrices of whatever moved this frame (both passes below reuse them):
+	dynamic_scene.update_transforms();
+
 	// Scene::Light light = scene.lights.front();
 	Scene::Light light = dynamic_scene.lights.front();
 
@@ -327,8 +410,8 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//
 	if (is_seeker) {
 		light_type = 2;
-		Player seeker = game.players.front();
-		glm::vec3 seeker_pos = glm::vec3(seeker.position.x, seeker.position.y, 0.05f);
+		glm::vec2 seeker_position = (has_prediction ? predicted_position : game.players.position[local]);
+		glm::vec3 seeker_pos = glm::vec3(seeker_position.x, seeker_position.y, 0.05f);
 		
 		light_pos = seeker_pos + glm::vec3(0.0f, 0.0f, 10.0f);
 		light_dir = glm::normalize(seeker_pos - light_pos);
@@ -398,10 +481,8 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	float baseline_y = H * 0.5f + (asc - desc) * 0.5f;
 	std::string text;
 	glm::vec4 col(1,1,1,1);
-	if (game.game_state == Game::GameState::BeforeStart) {
-		Player player = game.players.front();
-
-		if (!player.is_ready) text = "Press Space to be ready";
+	if (game.game_state == Game::GameState::BeforeStart && has_local) {
+		if (!game.players.is_ready[local]) text = "Press Space to be ready";
 		else text = "You are ready. Please wait for others to be ready";
 		draw_text(text, drawable_size.x/2, baseline_y, drawable_size.x, drawable_size.y, col);
 	}
@@ -457,8 +538,8 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 	// 	for (auto const &player : game.players) {
 	// 		glm::u8vec4 col = glm::u8vec4(player.color.x*255, player.color.y*255, player.color.z*255, 0xff);
-	// 		if (&player == &game.players.front()) {
-	// 			//mark current player (which server sends first):
+	// 		if (&player == local) {
+	// 			//mark current player:
 	// 			lines.draw(
 	// 				glm::vec3(player.position + Game::PlayerRadius * glm::vec2(-0.5f,-0.5f), 0.0f),
 	// 				glm::vec3(player.position + Game::PlayerRadius * glm::vec2( 0.5f, 0.5f), 0.0f),
@@ -490,7 +571,7 @@ std::list<Scene::Drawable>::iterator PlayMode::create_drawable(Scene &scene, std
 	scene.transforms.emplace_back();
 	Scene::Transform &dst_t = scene.transforms.back();
 	dst_t = *src_t;
-	dst_t.parent = nullptr;
+	dst_t.set_parent(nullptr);
 
 	scene.drawables.emplace_back(&dst_t);
     Scene::Drawable &dst_d = scene.drawables.back();
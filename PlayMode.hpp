@@ -2,6 +2,7 @@
 
 #include "Connection.hpp"
 #include "Game.hpp"
+#include "Interpolation.hpp"
 
 #include <glm/glm.hpp>
 
@@ -11,7 +12,7 @@
 #include "GlyphCache.hpp"
 
 struct PlayMode : Mode {
-	PlayMode(Client &client);
+	PlayMode(Client &client, float interpolation_delay = 0.1f);
 	virtual ~PlayMode();
 
 	//functions called by main loop:
@@ -27,6 +28,29 @@ struct PlayMode : Mode {
 	//latest game state (from server):
 	Game game;
 
+	//local time (seconds since the mode started):
+	double clock = 0.0;
+
+	//other players are drawn a little in the past, interpolated between server states:
+	Interpolation interpolation;
+
+	//controls are only sent when they change (or as a heartbeat):
+	Player::Controls sent_controls; //last controls sent
+	uint32_t controls_sequence = 0; //sequence number of the last controls message sent
+	float controls_heartbeat = 0.0f; //time left until unchanged controls are sent again
+
+	//the local player is predicted: drawn where the latest server state puts it,
+	// moved forward by the controls held since (which the server hasn't simulated yet):
+	struct HeldControls {
+		uint32_t sequence; //controls message these controls were sent in
+		Player::Controls controls;
+		float elapsed; //frame time the controls were held for
+	};
+	std::deque< HeldControls > unapplied_controls;
+	bool has_prediction = false;
+	glm::vec2 predicted_position = glm::vec2(0.0f);
+	glm::vec2 predicted_velocity = glm::vec2(0.0f);
+
 	//last message from server:
 	std::string server_message;
 
@@ -55,5 +79,5 @@ struct PlayMode : Mode {
 	std::list<Scene::Drawable>::iterator create_drawable(Scene &scene, std::list<Scene::Drawable>::iterator it_src);
 	void delete_drawable(Scene &scene, std::list<Scene::Drawable>::iterator it);
 
-	std::unordered_map<uint8_t, std::list<Scene::Drawable>::iterator> player_to_drawable;
+	std::unordered_map<Player::Id, std::list<Scene::Drawable>::iterator> player_to_drawable;
 };
@@ -0,0 +1,339 @@
+#include "RoomManager.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+Room::Room(uint32_t id_, Interest::Settings const &interest_) : id(id_), interest(interest_) {
+}
+
+void Room::tick() {
+	//joins, inputs, and leaves since the last tick:
+	{
+		std::lock_guard< std::mutex > lock(inbox_mutex);
+
+		for (uint64_t client : joins) {
+			clients.emplace(client, Client{ .player = game.spawn_player(), .interest = Interest(interest) });
+		}
+		joins.clear();
+
+		for (auto &[client, input] : inputs) {
+			auto f = clients.find(client);
+			if (f == clients.end()) continue;
+			Client &info = f->second;
+			if (input.has_controls) {
+				//merge with any presses the game hasn't handled yet:
+				Player::Controls &controls = game.players.controls[game.players.index(info.player)];
+				auto merge = [](Button &into, Button const &from) {
+					into.pressed = from.pressed;
+					into.downs = uint8_t(std::min(255, int(into.downs) + int(from.downs)));
+				};
+				merge(controls.left, input.controls.left);
+				merge(controls.right, input.controls.right);
+				merge(controls.up, input.controls.up);
+				merge(controls.down, input.controls.down);
+				merge(controls.jump, input.controls.jump);
+				info.controls_sequence = input.controls_sequence;
+				info.controls_ticks = 0;
+			}
+			if (input.has_ack) {
+				info.has_ack = true;
+				info.ack = input.ack;
+			}
+		}
+		inputs.clear();
+
+		for (uint64_t client : leaves) {
+			auto f = clients.find(client);
+			if (f == clients.end()) continue;
+			game.remove_player(f->second.player);
+			clients.erase(f);
+		}
+		leaves.clear();
+	}
+
+	//update current game state:
+	game.update(Game::Tick);
+	game.record_snapshot();
+	for (auto &[client, info] : clients) {
+		info.controls_ticks += 1;
+	}
+
+	//encode state for every client
+	// (each client gets the changes since the last state it acknowledged, or a full state if that is too old;
+	//  without interest management, these are encoded once per distinct baseline and shared;
+	//  with it, each client has its own subset of the players, so gets its own message)
+	std::vector< Outgoing > sends;
+	sends.reserve(clients.size());
+	std::shared_ptr< std::vector< uint8_t > const > full_state;
+	std::unordered_map< uint32_t, std::shared_ptr< std::vector< uint8_t > const > > delta_states;
+	for (auto &[client, info] : clients) {
+		std::shared_ptr< std::vector< uint8_t > const > state;
+		if (interest.enabled) {
+			state = info.interest.encode_state(game, info.player, info.has_ack ? &info.ack : nullptr);
+		} else {
+			Game::Snapshot const *baseline = (info.has_ack ? game.find_snapshot(info.ack.tick) : nullptr);
+			auto &shared = (baseline ? delta_states[baseline->tick] : full_state);
+			if (!shared) shared = game.encode_state(baseline);
+			state = shared;
+		}
+		uint16_t controls_ticks = uint16_t(std::min< uint32_t >(info.controls_ticks, 0xffff));
+		sends.emplace_back(Outgoing{ client, game.players.player_id[game.players.index(info.player)], info.controls_sequence, controls_ticks, state });
+	}
+	{
+		std::lock_guard< std::mutex > lock(outbox_mutex);
+		if (outbox.empty()) outbox.swap(sends);
+		else outbox.insert(outbox.end(), sends.begin(), sends.end());
+	}
+
+	accepting = (game.game_state == Game::GameState::BeforeStart);
+}
+
+//-----------------------------------------
+
+RoomManager::RoomManager(uint32_t worker_count, uint32_t room_size_, TickScheduler::Policy const &policy_, Interest::Settings const &interest_, std::function< void() > const &on_outbox_)
+	: room_size(room_size_), policy(policy_), interest(interest_), on_outbox(on_outbox_) {
+	assert(room_size > 0);
+	if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+
+	workers.reserve(worker_count);
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		workers.emplace_back(std::make_unique< Worker >());
+	}
+	//(start threads only once 'workers' won't be resized)
+	for (auto &worker : workers) {
+		worker->thread = std::thread(&RoomManager::run_worker, this, std::ref(*worker));
+	}
+}
+
+RoomManager::~RoomManager() {
+	stop = true;
+	for (auto &worker : workers) {
+		{ //(lock so the notify can't slip in between a worker's check and its wait)
+			std::lock_guard< std::mutex > lock(worker->mutex);
+		}
+		worker->wake.notify_one();
+	}
+	for (auto &worker : workers) {
+		worker->thread.join();
+	}
+}
+
+Room *RoomManager::join(uint64_t client) {
+	RoomInfo *target = nullptr;
+	for (auto &info : rooms) {
+		if (!info.room->closing && info.room->accepting && info.members < room_size) {
+			target = &info;
+			break;
+		}
+	}
+
+	if (!target) {
+		//open a new room on the worker with the fewest rooms:
+		uint32_t w = 0;
+		for (uint32_t i = 1; i < workers.size(); ++i) {
+			if (workers[i]->room_count < workers[w]->room_count) w = i;
+		}
+		rooms.emplace_back();
+		target = &rooms.back();
+		target->room = std::make_unique< Room >(next_room_id++, interest);
+		target->worker = w;
+
+		Worker &worker = *workers[w];
+		worker.room_count += 1;
+		{
+			std::lock_guard< std::mutex > lock(worker.mutex);
+			worker.added.emplace_back(target->room.get());
+		}
+		worker.wake.notify_one();
+	}
+
+	target->members += 1;
+	Room &room = *target->room;
+	{
+		std::lock_guard< std::mutex > lock(room.inbox_mutex);
+		room.joins.emplace_back(client);
+	}
+	return &room;
+}
+
+void RoomManager::leave(uint64_t client, Room *room) {
+	assert(room);
+	auto f = std::find_if(rooms.begin(), rooms.end(), [&](RoomInfo const &info){ return info.room.get() == room; });
+	assert(f != rooms.end());
+
+	{
+		std::lock_guard< std::mutex > lock(room->inbox_mutex);
+		room->leaves.emplace_back(client);
+		room->inputs.erase(client);
+	}
+
+	assert(f->members > 0);
+	f->members -= 1;
+	if (f->members == 0) {
+		//nobody left; the worker will drop the room on its next pass:
+		room->closing = true;
+	}
+}
+
+void RoomManager::deliver(std::function< void(Room::Outgoing const &) > const &send) {
+	std::vector< Room::Outgoing > sends;
+	for (auto &info : rooms) {
+		Room &room = *info.room;
+		{
+			std::lock_guard< std::mutex > lock(room.outbox_mutex);
+			sends.swap(room.outbox);
+		}
+		for (auto const &out : sends) {
+			send(out);
+		}
+		sends.clear();
+	}
+}
+
+void RoomManager::collect_closed() {
+	for (auto f = rooms.begin(); f != rooms.end(); ) {
+		if (f->room->closed) {
+			workers[f->worker]->room_count -= 1;
+			f = rooms.erase(f);
+		} else {
+			++f;
+		}
+	}
+}
+
+void RoomManager::report(std::ostream &out) {
+	struct Line {
+		uint32_t id;
+		uint32_t members;
+		TickStats metrics;
+	};
+	std::vector< Line > lines;
+	lines.reserve(rooms.size());
+
+	TickStats all;
+	uint32_t players = 0;
+	for (auto &info : rooms) {
+		Room &room = *info.room;
+		Line line{ room.id, info.members, TickStats() };
+		{
+			std::lock_guard< std::mutex > lock(room.metrics_mutex);
+			std::swap(line.metrics, room.metrics);
+		}
+		all.merge(line.metrics);
+		players += line.members;
+		lines.emplace_back(line);
+	}
+
+	auto ms = [](double seconds) { return seconds * 1000.0; };
+	auto summary = [&](TickStats const &stats) {
+		out << stats.processing.count << " ticks, "
+		    << "processing avg " << ms(stats.processing.mean()) << "ms p99 " << ms(stats.processing.percentile(0.99)) << "ms max " << ms(stats.processing.max_seconds) << "ms, "
+		    << "late p50 " << ms(stats.lateness.percentile(0.5)) << "ms p99 " << ms(stats.lateness.percentile(0.99)) << "ms max " << ms(stats.lateness.max_seconds) << "ms, "
+		    << stats.overruns << " overruns, " << stats.skipped << " skipped";
+	};
+
+	out << "[rooms] " << rooms.size() << " rooms, " << players << " players; room ";
+	summary(all);
+	out << '\n';
+	out << "  processing: "; all.processing.print_buckets(out); out << '\n';
+	out << "  lateness: "; all.lateness.print_buckets(out); out << '\n';
+
+	//whole passes over each worker's rooms:
+	for (uint32_t w = 0; w < workers.size(); ++w) {
+		TickStats stats;
+		{
+			std::lock_guard< std::mutex > lock(workers[w]->mutex);
+			std::swap(stats, workers[w]->metrics);
+		}
+		out << "  worker " << w << ": " << workers[w]->room_count << " rooms, ";
+		summary(stats);
+		out << '\n';
+	}
+
+	//slowest few rooms:
+	std::sort(lines.begin(), lines.end(), [](Line const &a, Line const &b){ return a.metrics.processing.max_seconds > b.metrics.processing.max_seconds; });
+	for (size_t i = 0; i < lines.size() && i < 5; ++i) {
+		Line const &line = lines[i];
+		out << "  room " << line.id << ": " << line.members << " players, ";
+		summary(line.metrics);
+		out << '\n';
+	}
+	out.flush();
+}
+
+void RoomManager::run_worker(Worker &worker) {
+	using Clock = TickScheduler::Clock;
+
+	#ifdef __linux__
+	//linux rounds timed waits up by the thread's timer slack (50us by default); ask for precise wakeups instead:
+	prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+	#endif
+
+	auto const tick = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(Game::Tick));
+	TickScheduler scheduler(tick, policy);
+	scheduler.start(Clock::now());
+
+	std::vector< Room * > mine; //rooms this worker ticks
+	while (!stop) {
+		//pick up new rooms:
+		{
+			std::lock_guard< std::mutex > lock(worker.mutex);
+			mine.insert(mine.end(), worker.added.begin(), worker.added.end());
+			worker.added.clear();
+		}
+
+		//let go of rooms that are closing (the network thread frees them):
+		for (size_t i = 0; i < mine.size(); ) {
+			if (mine[i]->closing) {
+				mine[i]->closed = true;
+				mine[i] = mine.back();
+				mine.pop_back();
+			} else {
+				++i;
+			}
+		}
+
+		//run every tick that is due (more than one if catching up):
+		Clock::time_point scheduled;
+		uint64_t skipped_before = scheduler.skipped;
+		bool ticked = false;
+		while (!stop && scheduler.next_due(Clock::now(), &scheduled)) {
+			ticked = ticked || !mine.empty();
+			uint64_t skipped = scheduler.skipped - skipped_before;
+			skipped_before = scheduler.skipped;
+
+			Clock::time_point pass_start = Clock::now();
+			for (Room *room : mine) {
+				Clock::time_point start = Clock::now();
+				room->tick();
+				Clock::time_point end = Clock::now();
+
+				std::lock_guard< std::mutex > lock(room->metrics_mutex);
+				room->metrics.processing.add(std::chrono::duration< double >(end - start).count());
+				room->metrics.lateness.add(std::chrono::duration< double >(start - scheduled).count());
+				if (end - start > tick) room->metrics.overruns += 1;
+				room->metrics.skipped += skipped;
+			}
+			Clock::time_point pass_end = Clock::now();
+
+			std::lock_guard< std::mutex > lock(worker.mutex);
+			worker.metrics.processing.add(std::chrono::duration< double >(pass_end - pass_start).count());
+			worker.metrics.lateness.add(std::chrono::duration< double >(pass_start - scheduled).count());
+			if (pass_end - pass_start > tick) worker.metrics.overruns += 1;
+			worker.metrics.skipped += skipped;
+		}
+		//(once after all the due ticks, not per room, so the network thread wakes about once per worker per tick)
+		if (ticked && on_outbox) on_outbox();
+
+		//sleep until the next tick (waking early for new rooms or shutdown):
+		scheduler.wait_until(scheduler.next, [&](Clock::time_point until){
+			std::unique_lock< std::mutex > lock(worker.mutex);
+			return worker.wake.wait_until(lock, until, [&](){ return stop || !worker.added.empty(); });
+		});
+	}
+}
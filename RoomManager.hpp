@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Game.hpp"
+#include "Interest.hpp"
+#include "TickScheduler.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <iosfwd>
+
+//Runs many independent matches ("rooms", each its own Game) in one server process.
+//
+// Rooms are sharded across a fixed pool of worker threads; each worker runs a TickScheduler and ticks all of its rooms
+// every Game::Tick (so one wakeup serves every room on the worker).
+// The network thread owns every Connection; it only talks to a room through the room's inbox (joins, leaves, inputs)
+// and outbox (encoded state messages), so workers never touch a Connection.
+// Clients are named by a serial number the network thread assigns, since Connection addresses get reused.
+
+struct Room {
+	Room(uint32_t id, Interest::Settings const &interest);
+
+	uint32_t const id;
+	Interest::Settings const interest; //what each client is sent (if disabled, every client gets every player)
+
+	//---- worker-owned (only touched by the worker that ticks this room) ----
+
+	Game game;
+	struct Client {
+		PlayerStore::Handle player = PlayerStore::InvalidHandle;
+		bool has_ack = false; //has the client acknowledged any state message yet?
+		StateAck ack; //latest state message the client acknowledged
+		uint32_t controls_sequence = 0; //latest controls message applied to the player
+		uint32_t controls_ticks = 0; //ticks simulated since those controls arrived (clients send only changes, so they stay in effect)
+		Interest interest; //(used if interest management is enabled)
+	};
+	std::unordered_map< uint64_t, Client > clients;
+
+	//apply the inbox, advance the game, and queue state messages in the outbox:
+	void tick();
+
+	//---- inbox (network thread -> worker) ----
+
+	std::mutex inbox_mutex;
+	std::vector< uint64_t > joins; //clients to add (in the order they arrived)
+	std::vector< uint64_t > leaves; //clients to remove
+	//what each client has sent since the last tick:
+	struct Input {
+		bool has_controls = false;
+		Player::Controls controls; //(all messages since the last tick merged: presses accumulate; 'pressed' is the latest state)
+		uint32_t controls_sequence = 0; //sequence number of the latest controls message
+		bool has_ack = false;
+		StateAck ack;
+	};
+	std::unordered_map< uint64_t, Input > inputs;
+
+	//---- outbox (worker -> network thread) ----
+
+	struct Outgoing {
+		uint64_t client;
+		Player::Id player_id; //player the client controls
+		uint32_t controls_sequence; //latest controls message from the client included in the state
+		uint16_t controls_ticks; //ticks simulated with those controls
+		std::shared_ptr< std::vector< uint8_t > const > state; //(shared between clients with the same baseline, without interest management)
+	};
+	std::mutex outbox_mutex;
+	std::vector< Outgoing > outbox;
+
+	//---- status (written by the worker, read by anyone) ----
+
+	std::atomic< bool > accepting{true}; //is the match still waiting to start (so new players can join)?
+	std::atomic< bool > closing{false}; //set by the network thread once the room is empty; worker stops ticking it
+	std::atomic< bool > closed{false}; //set by the worker once it has let go of the room
+
+	//tick timing since the last report (recorded by the worker):
+	std::mutex metrics_mutex;
+	TickStats metrics;
+};
+
+struct RoomManager {
+	//'workers' threads (0 = one per core); 'room_size' players per room at most; 'policy' for every worker's tick schedule;
+	// 'interest' for what every room sends its clients; 'on_outbox' is called (from a worker thread) after rooms have
+	// queued state messages, so the network thread can wait for that rather than checking often:
+	RoomManager(uint32_t workers, uint32_t room_size, TickScheduler::Policy const &policy, Interest::Settings const &interest = Interest::Settings(),
+		std::function< void() > const &on_outbox = nullptr);
+	~RoomManager();
+
+	//---- called from the network thread ----
+
+	//lobby: put a new client in a room that hasn't started yet and has space, opening a new room if needed:
+	Room *join(uint64_t client);
+	//client disconnected:
+	void leave(uint64_t client, Room *room);
+	//hand every queued state message to 'send':
+	void deliver(std::function< void(Room::Outgoing const &) > const &send);
+	//free rooms the workers are done with:
+	void collect_closed();
+	//print tick timing histograms since the last report (and reset them):
+	void report(std::ostream &out);
+
+	uint32_t const room_size;
+	TickScheduler::Policy const policy;
+	Interest::Settings const interest;
+	std::function< void() > const on_outbox;
+
+	//rooms and how many clients the network thread has put in each:
+	struct RoomInfo {
+		std::unique_ptr< Room > room;
+		uint32_t members = 0;
+		uint32_t worker = 0;
+	};
+	std::vector< RoomInfo > rooms;
+	uint32_t next_room_id = 1;
+
+	//---- worker pool ----
+
+	struct Worker {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::vector< Room * > added; //rooms handed to this worker (picked up on its next pass)
+		TickStats metrics; //timing of whole passes over the worker's rooms since the last report (guarded by 'mutex')
+		uint32_t room_count = 0; //(network thread's count, for balancing)
+	};
+	std::vector< std::unique_ptr< Worker > > workers;
+	std::atomic< bool > stop{false};
+
+	void run_worker(Worker &worker);
+};
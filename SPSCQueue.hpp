@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+//Lock-free queue between exactly one producer thread and one consumer thread:
+// a fixed-size ring of slots, with the producer only writing 'tail' and the consumer only writing 'head',
+// so neither side ever waits for the other (push fails when the ring is full; pop fails when it is empty).
+// Capacity is fixed at construction (rounded up to a power of two), so push/pop never allocate.
+
+template< typename T >
+struct SPSCQueue {
+	explicit SPSCQueue(size_t min_capacity) {
+		size_t capacity = 1;
+		while (capacity < min_capacity) capacity *= 2;
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+	SPSCQueue(SPSCQueue const &) = delete;
+	SPSCQueue &operator=(SPSCQueue const &) = delete;
+
+	size_t capacity() const { return slots.size(); }
+
+	//(producer) add a value at the back; returns false (and does nothing) if the queue is full:
+	bool push(T const &value) {
+		size_t at = tail.load(std::memory_order_relaxed);
+		if (at - cached_head == slots.size()) {
+			cached_head = head.load(std::memory_order_acquire);
+			if (at - cached_head == slots.size()) return false;
+		}
+		slots[at & mask] = value;
+		tail.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(consumer) take the value at the front; returns false if the queue is empty:
+	bool pop(T *value) {
+		assert(value);
+		size_t at = head.load(std::memory_order_relaxed);
+		if (at == cached_tail) {
+			cached_tail = tail.load(std::memory_order_acquire);
+			if (at == cached_tail) return false;
+		}
+		*value = slots[at & mask];
+		head.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(producer) add up to 'count' values at the back; returns how many were added (fewer than 'count' if the queue fills):
+	size_t push(T const *values, size_t count) {
+		size_t at = tail.load(std::memory_order_relaxed);
+		if (slots.size() - (at - cached_head) < count) {
+			cached_head = head.load(std::memory_order_acquire);
+		}
+		size_t n = std::min(count, slots.size() - (at - cached_head));
+		for (size_t k = 0; k < n; ++k) {
+			slots[(at + k) & mask] = values[k];
+		}
+		tail.store(at + n, std::memory_order_release);
+		return n;
+	}
+
+	//(consumer) take up to 'count' values from the front; returns how many were taken (fewer than 'count' if the queue empties):
+	size_t pop(T *values, size_t count) {
+		size_t at = head.load(std::memory_order_relaxed);
+		if (cached_tail - at < count) {
+			cached_tail = tail.load(std::memory_order_acquire);
+		}
+		size_t n = std::min(count, cached_tail - at);
+		for (size_t k = 0; k < n; ++k) {
+			values[k] = slots[(at + k) & mask];
+		}
+		head.store(at + n, std::memory_order_release);
+		return n;
+	}
+
+	//internals:
+	std::vector< T > slots;
+	size_t mask = 0;
+
+	//(each index on its own cache line, along with the other side's last-seen copy, so the two threads don't share lines)
+	alignas(64) std::atomic< size_t > head{0}; //next slot to pop (written by the consumer)
+	size_t cached_tail = 0; //(consumer's copy of 'tail')
+	alignas(64) std::atomic< size_t > tail{0}; //next slot to push (written by the producer)
+	size_t cached_head = 0; //(producer's copy of 'head')
+};
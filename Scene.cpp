@@ -5,6 +5,7 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <fstream>
 
 //-------------------------
@@ -56,18 +57,81 @@ glm::mat4x3 Scene::Transform::make_local_from_parent() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_world_from_local() const {
-	if (!parent) {
-		return make_parent_from_local();
-	} else {
-		return parent->make_world_from_local() * glm::mat4(make_parent_from_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+glm::mat4x3 const &Scene::Transform::make_world_from_local() const {
+	if (world_from_local_dirty) {
+		if (!parent) {
+			world_from_local = make_parent_from_local();
+		} else {
+			world_from_local = parent->make_world_from_local() * glm::mat4(make_parent_from_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		world_from_local_dirty = false;
 	}
+	return world_from_local;
 }
-glm::mat4x3 Scene::Transform::make_local_from_world() const {
-	if (!parent) {
-		return make_local_from_parent();
-	} else {
-		return make_local_from_parent() * glm::mat4(parent->make_local_from_world()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+glm::mat4x3 const &Scene::Transform::make_local_from_world() const {
+	if (local_from_world_dirty) {
+		if (!parent) {
+			local_from_world = make_local_from_parent();
+		} else {
+			local_from_world = make_local_from_parent() * glm::mat4(parent->make_local_from_world()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		local_from_world_dirty = false;
+	}
+	return local_from_world;
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	position = position_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	rotation = rotation_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	scale = scale_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_parent(Transform *parent_) {
+	if (parent_ != parent) {
+		if (parent) {
+			auto &siblings = parent->children;
+			siblings.erase(std::find(siblings.begin(), siblings.end(), this));
+		}
+		parent = parent_;
+		if (parent) parent->children.emplace_back(this);
+	}
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	//(if both caches are already dirty, so are all the descendants', so there is nothing more to do)
+	if (world_from_local_dirty && local_from_world_dirty) return;
+	world_from_local_dirty = true;
+	local_from_world_dirty = true;
+	for (Transform *child : children) {
+		child->mark_dirty();
+	}
+}
+
+Scene::Transform &Scene::Transform::operator=(Transform const &other) {
+	if (this == &other) return *this;
+	name = other.name;
+	position = other.position;
+	rotation = other.rotation;
+	scale = other.scale;
+	set_parent(other.parent); //(also marks dirty)
+	return *this;
+}
+
+Scene::Transform::~Transform() {
+	set_parent(nullptr);
+	for (Transform *child : children) {
+		child->parent = nullptr;
+		child->mark_dirty();
 	}
 }
 
@@ -79,6 +143,12 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+void Scene::update_transforms() {
+	//(each dirty transform is refreshed once, after its dirty ancestors; clean ones are skipped)
+	for (auto const &transform : transforms) {
+		if (transform.world_from_local_dirty) transform.make_world_from_local();
+	}
+}
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
@@ -231,7 +301,7 @@ void Scene::load(std::string const &filename,
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
@@ -240,9 +310,9 @@ void Scene::load(std::string const &filename,
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		t->set_position(h.position);
+		t->set_rotation(h.rotation);
+		t->set_scale(h.scale);
 
 		hierarchy_transforms.emplace_back(t);
 	}
@@ -342,19 +412,21 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
 		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		transforms.back().set_position(t.position);
+		transforms.back().set_rotation(t.rotation);
+		transforms.back().set_scale(t.scale);
+		//(parent is set below, once every transform has a copy)
 
 		//store mapping between transforms old and new:
 		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
 		assert(ret.second);
 	}
 
-	//update transform parents:
+	//set transform parents:
+	auto other_t = other.transforms.begin();
 	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+		t.set_parent(transform_to_transform.at(other_t->parent));
+		++other_t;
 	}
 
 	//copy other's drawables, updating transform pointers:
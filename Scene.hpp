@@ -28,6 +28,7 @@ struct Scene {
 		std::string name;
 
 		//The core function of a transform is to store a transformation in the world:
+		// (read these directly, but change them with the set_* functions below, so cached matrices get updated)
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
 		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -35,18 +36,38 @@ struct Scene {
 		//The transform above may be relative to some parent transform:
 		Transform *parent = nullptr;
 
+		void set_position(glm::vec3 const &position);
+		void set_rotation(glm::quat const &rotation);
+		void set_scale(glm::vec3 const &scale);
+		void set_parent(Transform *parent);
+		//mark this transform's (and its descendants') cached matrices as out of date
+		// (the setters do this; call it yourself after changing the members above directly):
+		void mark_dirty();
+
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_parent_from_local() const;
 		glm::mat4x3 make_local_from_parent() const;
-		// ..relative to the world:
-		glm::mat4x3 make_world_from_local() const;
-		glm::mat4x3 make_local_from_world() const;
+		// ..relative to the world (cached; recomputed only after this transform or one of its ancestors changes):
+		glm::mat4x3 const &make_world_from_local() const;
+		glm::mat4x3 const &make_local_from_world() const;
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		//assigning copies the name, position, rotation, scale, and parent (but not the children):
+		Transform &operator=(Transform const &);
+		//(detaches from parent and children)
+		~Transform();
+
+		//internals:
+		std::vector< Transform * > children; //(kept by set_parent)
+		//cached matrices; if a transform's cache is dirty, so are those of all of its descendants:
+		mutable glm::mat4x3 world_from_local = glm::mat4x3(1.0f);
+		mutable glm::mat4x3 local_from_world = glm::mat4x3(1.0f);
+		mutable bool world_from_local_dirty = true;
+		mutable bool local_from_world_dirty = true;
 	};
 
 	struct Drawable {
@@ -122,6 +143,10 @@ struct Scene {
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Bring every changed transform's cached world_from_local matrix up to date
+	// (call once per frame, after moving things and before drawing; drawing without it still works, updating as it goes):
+	void update_transforms();
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
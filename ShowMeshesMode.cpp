@@ -107,12 +107,12 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -1,14 +1,27 @@
 #include "Sound.hpp"
+#include "SPSCQueue.hpp"
+#include "sound_mix.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
 
 #include <SDL3/SDL.h>
 
-#include <list>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
+#include <iomanip>
 #include <algorithm>
+#include <thread>
+
+//The game thread never touches the mixer's state: every change is a Command, pushed onto a lock-free
+// single-producer/single-consumer queue that the audio callback drains before it mixes each block.
+//
+//Voices live in a fixed number of slots, sized by Sound::init(), so the audio callback never allocates or frees:
+// the game thread picks the slot for each new sample (taking a busy one by priority if it must),
+// and the audio callback hands finished slots back through a second queue.
 
 //local (to this file) data used by the audio system:
 namespace {
@@ -19,46 +32,463 @@ namespace {
 	//The audio device:
 	SDL_AudioStream *stream = nullptr;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//rendering offline (see Sound::init_offline) instead of to the audio device?
+	bool offline = false;
+
+	//mixing loop to use (the fastest this CPU supports; see sound_mix.hpp):
+	MixKernel mix_kernel = MixKernel::Scalar;
+
+	//space for samples that have to be copied or converted before they can be mixed (streamed, or 16-bit):
+	// (one block's worth, allocated by reset_mixer so mixing never allocates)
+	std::vector< float > convert_scratch;
+
+	//a change requested by the game thread:
+	struct Command {
+		enum class Type : uint8_t {
+			Play, //start 'sample' (or 'streaming') as 'id' (with 'volume', 'loop', and 'pan' or 'position'/'radius')
+			SetVolume, //set the volume of sample 'id' (or the global volume, if 'id' is 0)
+			SetPan,
+			SetPosition,
+			SetHalfVolumeRadius,
+			Stop,
+			StopAll,
+			SetListener, //'position' and 'right'
+		} type;
+		bool loop = false;
+		uint32_t id = 0;
+		float ramp = 0.0f;
+		float volume = 1.0f;
+		float pan = 0.0f; //(NaN for 3D samples)
+		float radius = 0.0f;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f);
+		Sound::Sample const *sample = nullptr;
+		Sound::StreamingSample *streaming = nullptr;
+	};
+	//(big enough that the game thread won't fill it between two callbacks)
+	constexpr size_t CommandCapacity = 4096;
+	SPSCQueue< Command > commands(CommandCapacity);
+
+	//ids of samples that have finished playing (pushed by the audio callback, popped by the game thread):
+	// (every finished sample was started by a command, so this rarely holds more than a few blocks' worth of plays;
+	//  if it ever fills, the game thread just keeps thinking those slots are busy until it takes them back by priority)
+	SPSCQueue< uint32_t > finished(CommandCapacity);
+
+	//PlayingSample ids hold a voice slot in the low bits and that slot's generation in the high bits
+	// (generations start at 1, so no id is 0):
+	constexpr uint32_t SlotBits = 16;
+	constexpr uint32_t SlotMask = (1u << SlotBits) - 1;
+	static_assert(Sound::MaxMaxVoices <= SlotMask, "voice slots fit in an id");
+	uint32_t slot_of(uint32_t id) { return id & SlotMask; }
+
+	//---- game thread state ----
+
+	//what the game thread knows about each voice slot:
+	struct Slots {
+		std::vector< uint32_t > id; //id of the sample playing in each slot (or that last played there)
+		std::vector< uint8_t > busy; //has the slot been given out, and not yet reported finished?
+		std::vector< int > priority; //priority of the sample in each busy slot
+		std::vector< uint64_t > started; //value of 'plays' when each slot's sample started (to find the oldest)
+		std::vector< uint32_t > free; //slots that aren't busy (used as a stack)
+		uint64_t plays = 0;
+	} slots;
+
+	//commands that didn't fit in the queue, and samples started by taking another sample's voice:
+	uint64_t dropped_commands = 0;
+	uint64_t stolen_voices = 0;
+
+	bool send(Command const &command) {
+		if (!stream && !offline) return false; //(no audio device, so nothing to tell)
+		if (!commands.push(command)) {
+			if (dropped_commands == 0) std::cerr << "WARNING: audio command queue is full; dropping commands." << std::endl;
+			dropped_commands += 1;
+			return false;
+		}
+		return true;
+	}
+
+	void free_slot(uint32_t slot) {
+		assert(slots.busy[slot]);
+		slots.busy[slot] = 0;
+		slots.free.emplace_back(slot); //(never grows past its reserved size)
+	}
+
+	//take back the slots of samples the audio callback has finished:
+	void collect_finished() {
+		uint32_t id;
+		while (finished.pop(&id)) {
+			uint32_t slot = slot_of(id);
+			//(unless the slot has been given to a newer sample since)
+			if (slots.busy[slot] && slots.id[slot] == id) free_slot(slot);
+		}
+	}
+
+	//give a new sample a slot; returns its id, or 0 if every slot holds a sample that matters more:
+	uint32_t claim_slot(int priority) {
+		collect_finished();
+
+		uint32_t slot;
+		if (!slots.free.empty()) {
+			slot = slots.free.back();
+			slots.free.pop_back();
+		} else {
+			//take the lowest-priority voice (the oldest, among equals):
+			slot = 0;
+			for (uint32_t s = 1; s < uint32_t(slots.id.size()); ++s) {
+				if (slots.priority[s] < slots.priority[slot]
+				 || (slots.priority[s] == slots.priority[slot] && slots.started[s] < slots.started[slot])) {
+					slot = s;
+				}
+			}
+			if (slots.priority[slot] > priority) return 0;
+			stolen_voices += 1;
+		}
+
+		uint32_t generation = (slots.id[slot] >> SlotBits) % SlotMask + 1;
+		slots.id[slot] = (generation << SlotBits) | slot;
+		slots.busy[slot] = 1;
+		slots.priority[slot] = priority;
+		slots.started[slot] = slots.plays++;
+		return slots.id[slot];
+	}
+
+	//start a sample (fills in the command's id):
+	Sound::PlayingSample start(Command command, int priority) {
+		if ((!stream && !offline) || (command.sample && command.sample->length() == 0)) return Sound::PlayingSample{};
+		command.id = claim_slot(priority);
+		if (command.id == 0) return Sound::PlayingSample{};
+		if (!send(command)) {
+			free_slot(slot_of(command.id));
+			return Sound::PlayingSample{};
+		}
+		return Sound::PlayingSample{ command.id };
+	}
+
+	//---- mixer state (only touched by the audio callback) ----
+
+	constexpr uint32_t InvalidIndex = ~0u;
+
+	//a sample whose voice is taken fades out over this long (instead of clicking off) on one of a few spare voices:
+	constexpr float StolenFade = 0.005f;
+	constexpr uint32_t SpareVoices = 8;
+
+	//the samples being played, as parallel arrays indexed [0, count)
+	// (removing one moves the last into its place; every array is sized for the maximum number of voices, plus the spares, by Sound::init()):
+	struct Voices {
+		uint32_t count = 0;
+		uint32_t fading = 0; //how many voices are stolen samples fading out (these have id 0 and no slot)
+
+		std::vector< uint32_t > id; //PlayingSample id
+		std::vector< Sound::Sample const * > sample; //sample being played (nullptr if streaming)
+		std::vector< Sound::StreamingSample * > streaming; //streaming sample being played (nullptr if not)
+		std::vector< uint32_t > i; //next data value to read
+		std::vector< uint8_t > loop; //should playback loop after data runs out?
+		std::vector< uint8_t > stopping; //is playing stopping?
+
+		std::vector< Sound::Ramp< float > > volume;
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		std::vector< Sound::Ramp< float > > pan;
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		std::vector< Sound::Ramp< glm::vec3 > > position;
+		std::vector< Sound::Ramp< float > > half_volume_radius;
+
+		std::vector< uint32_t > index_of_slot; //index of the voice in each slot (InvalidIndex if the slot is empty)
+
+		bool is_3D(uint32_t v) const { return !(pan[v].value == pan[v].value); }
+
+		//index of the voice playing sample 'id', or InvalidIndex if it has finished (or lost its slot):
+		// (sample_id is never 0, so this never finds a fading voice)
+		uint32_t find(uint32_t sample_id) const {
+			uint32_t v = index_of_slot[slot_of(sample_id)];
+			if (v == InvalidIndex || id[v] != sample_id) return InvalidIndex;
+			return v;
+		}
+
+		//make room for 'capacity' voices (game thread, before the audio callback starts):
+		void resize(uint32_t capacity) {
+			count = 0;
+			fading = 0;
+			uint32_t total = capacity + SpareVoices;
+			id.assign(total, 0);
+			sample.assign(total, nullptr);
+			streaming.assign(total, nullptr);
+			i.assign(total, 0);
+			loop.assign(total, 0);
+			stopping.assign(total, 0);
+			volume.assign(total, Sound::Ramp< float >(1.0f));
+			pan.assign(total, Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN()));
+			position.assign(total, Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN()));
+			half_volume_radius.assign(total, Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN()));
+			index_of_slot.assign(capacity, InvalidIndex);
+		}
+
+		//copy everything about voice 'from' to index 'to' (leaves index_of_slot alone):
+		void copy(uint32_t to, uint32_t from) {
+			id[to] = id[from];
+			sample[to] = sample[from];
+			streaming[to] = streaming[from];
+			i[to] = i[from];
+			loop[to] = loop[from];
+			stopping[to] = stopping[from];
+			volume[to] = volume[from];
+			pan[to] = pan[from];
+			position[to] = position[from];
+			half_volume_radius[to] = half_volume_radius[from];
+		}
+
+		//move the sample playing at index 'v' onto a spare voice, fading it out quickly, so 'v' can start something else;
+		// returns false (and leaves 'v' alone) if every spare voice is already fading:
+		bool fade_out(uint32_t v) {
+			assert(v < count);
+			if (fading == SpareVoices) return false;
+			assert(count < id.size());
+			uint32_t f = count++;
+			fading += 1;
+			copy(f, v);
+			id[f] = 0;
+			if (!stopping[f]) {
+				stopping[f] = 1;
+				volume[f].set(0.0f, StolenFade);
+			} else {
+				volume[f].ramp = std::min(volume[f].ramp, StolenFade);
+			}
+			return true;
+		}
+
+		//remove the voice at index 'v' by moving the last voice into its place:
+		void remove(uint32_t v) {
+			assert(v < count);
+			if (id[v] != 0) index_of_slot[slot_of(id[v])] = InvalidIndex;
+			else fading -= 1;
+			uint32_t last = count - 1;
+			if (v != last) {
+				copy(v, last);
+				if (id[v] != 0) index_of_slot[slot_of(id[v])] = v;
+			}
+			count = last;
+		}
+	} voices;
+
+	//global volume control:
+	Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+	//global listener information:
+	Sound::Ramp< glm::vec3 > listener_position = Sound::Ramp< glm::vec3 >(0.0f); //listener's location
+	Sound::Ramp< glm::vec3 > listener_right = Sound::Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
 
 }
 
 //public-facing data:
 
-//global volume control:
-Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
-
-//global listener information:
+//global listener (only sends commands):
 Sound::Listener Sound::listener;
 
-//This audio-mixing callback is defined below:
+//This audio-mixing callback (and the mixing it does) is defined below:
 void mix_audio(void *, SDL_AudioStream *stream, int additional_amount, int total_amount);
+void mix_block(float *out, uint32_t samples);
 
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
+Sound::Sample::Sample(std::string const &filename, Format format) {
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+		if (format == Format::PCM16) load_wav(filename, &data16);
+		else load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		if (format == Format::PCM16) {
+			//decode a piece at a time, so the whole file is never held as float:
+			std::cout << "loading '" << filename << "'..."; std::cout.flush();
+			OpusReader reader(filename);
+			if (reader.length() >= 0) data16.reserve(size_t(reader.length()));
+			std::vector< float > chunk(4096);
+			while (uint32_t got = reader.read(chunk.data(), uint32_t(chunk.size()))) {
+				for (uint32_t i = 0; i < got; ++i) {
+					data16.emplace_back(float_to_pcm16(chunk[i]));
+				}
+			}
+			std::cout << " done." << std::endl;
+		} else {
+			load_opus(filename, &data);
+		}
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".wav\" or \".opus\" -- unsure how to load.");
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, Format format) {
+	if (format == Format::PCM16) {
+		data16.reserve(data_.size());
+		for (float d : data_) {
+			data16.emplace_back(float_to_pcm16(d));
+		}
+	} else {
+		data = data_;
+	}
+}
+
+Sound::Sample const &Sound::SampleBank::load(std::string const &filename) {
+	auto f = samples.find(filename);
+	if (f == samples.end()) {
+		f = samples.emplace(filename, std::make_unique< Sample >(filename, format)).first;
+	}
+	return *f->second;
 }
 
+size_t Sound::SampleBank::bytes() const {
+	size_t total = 0;
+	for (auto const &[filename, sample] : samples) {
+		total += sample->bytes();
+	}
+	return total;
+}
+
+void Sound::SampleBank::report(std::ostream &out) const {
+	//(put the stream's number formatting back afterward)
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	size_t as_float = 0;
+	double seconds = 0.0;
+	out << "Sample bank (" << samples.size() << " samples):\n";
+	for (auto const &[filename, sample] : samples) {
+		out << "  " << std::setw(9) << std::fixed << std::setprecision(2) << (sample->length() / double(AUDIO_RATE)) << "s "
+		    << std::setw(8) << std::setprecision(1) << (sample->bytes() / 1024.0) << " KiB "
+		    << (sample->format() == Sample::Format::PCM16 ? "int16 " : "float ")
+		    << filename << "\n";
+		as_float += sample->length() * sizeof(float);
+		seconds += sample->length() / double(AUDIO_RATE);
+	}
+	out << "  total: " << std::fixed << std::setprecision(2) << seconds << "s of audio in "
+	    << std::setprecision(1) << (bytes() / 1024.0) << " KiB (" << (as_float / 1024.0) << " KiB as float)." << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
+
+//decodes a streaming sample ahead of playback, on its own thread:
+struct Sound::StreamingSample::Decoder {
+	Decoder(std::string const &filename);
+	~Decoder();
+
+	//(decoding thread) decode into 'ring' until it is full:
+	void fill();
+
+	OpusReader reader;
 
+	//decoded samples waiting to be played (decoding thread pushes, audio callback pops):
+	// (a second of audio: much longer than the decoding thread sleeps, but small next to a whole song)
+	SPSCQueue< float > ring = SPSCQueue< float >(AUDIO_RATE);
+
+	//(decoding thread) decoded samples that didn't fit in the ring yet:
+	std::vector< float > pending = std::vector< float >(4096);
+	uint32_t pending_begin = 0, pending_end = 0;
+	bool empty_file = false;
+
+	std::atomic< bool > quit{false};
+	std::atomic< uint32_t > underruns{0}; //blocks where the ring ran out before the audio callback had enough (written by the audio callback)
+	std::thread thread;
+};
+
+Sound::StreamingSample::Decoder::Decoder(std::string const &filename) : reader(filename) {
+	//have some audio ready before anything can play:
+	fill();
+
+	thread = std::thread([this](){
+		try {
+			while (!quit.load(std::memory_order_relaxed)) {
+				fill();
+				//(the ring holds a second, so checking this often keeps it nearly full)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		} catch (std::exception const &e) {
+			std::cerr << "Stopped streaming '" << reader.filename << "':\n" << e.what() << std::endl;
+		}
+	});
+}
+
+Sound::StreamingSample::Decoder::~Decoder() {
+	quit = true;
+	thread.join();
+	if (underruns) {
+		std::cerr << "WARNING: streaming '" << reader.filename << "' fell behind playback " << underruns << " times." << std::endl;
+	}
+}
+
+void Sound::StreamingSample::Decoder::fill() {
+	while (!empty_file) {
+		if (pending_begin == pending_end) {
+			pending_begin = 0;
+			pending_end = reader.read(pending.data(), uint32_t(pending.size()));
+			if (pending_end == 0) {
+				//loop by going back to the start of the file:
+				reader.rewind();
+				pending_end = reader.read(pending.data(), uint32_t(pending.size()));
+				if (pending_end == 0) {
+					std::cerr << "WARNING: '" << reader.filename << "' has no audio to stream." << std::endl;
+					empty_file = true;
+					return;
+				}
+			}
+		}
+		pending_begin += uint32_t(ring.push(pending.data() + pending_begin, pending_end - pending_begin));
+		if (pending_begin < pending_end) return; //ring is full
+	}
+}
+
+Sound::StreamingSample::StreamingSample(std::string const &filename) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+		throw std::runtime_error("StreamingSample '" + filename + "' doesn't end in \".opus\" -- only opus files can be streamed.");
+	}
+	decoder = std::make_unique< Decoder >(filename);
+	std::cout << "streaming '" << filename << "'." << std::endl;
+}
+
+Sound::StreamingSample::~StreamingSample() {
+}
+
+
+
+//helper: start from silence with 'max_voices' empty voice slots (while nothing is mixing):
+void reset_mixer(uint32_t max_voices) {
+	if (max_voices == 0 || max_voices > Sound::MaxMaxVoices) {
+		throw std::runtime_error("Sound: max_voices must be between 1 and " + std::to_string(Sound::MaxMaxVoices) + ", not " + std::to_string(max_voices) + ".");
+	}
+
+	//voice slots (every slot starts at generation 0, so the first sample in each gets generation 1):
+	slots.id.resize(max_voices);
+	for (uint32_t s = 0; s < max_voices; ++s) slots.id[s] = s;
+	slots.busy.assign(max_voices, 0);
+	slots.priority.assign(max_voices, 0);
+	slots.started.assign(max_voices, 0);
+	slots.free.clear();
+	slots.free.reserve(max_voices);
+	for (uint32_t s = max_voices; s > 0; --s) slots.free.emplace_back(s - 1); //(so slot 0 is used first)
+	slots.plays = 0;
+	stolen_voices = 0;
+	voices.resize(max_voices);
+	convert_scratch.resize(Sound::MaxBlockFrames);
+
+	//forget anything left over from before:
+	Command command;
+	while (commands.pop(&command)) { }
+	uint32_t id;
+	while (finished.pop(&id)) { }
+	volume = Sound::Ramp< float >(1.0f);
+	listener_position = Sound::Ramp< glm::vec3 >(0.0f);
+	listener_right = Sound::Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f);
+}
+
+void Sound::init(uint32_t max_voices) {
+	reset_mixer(max_voices);
 
-void Sound::init() {
 	if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 		return;
 	}
 
+	mix_kernel = best_mix_kernel();
+
 	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
 	SDL_AudioSpec spec{ .format=SDL_AUDIO_F32, .channels=2, .freq=AUDIO_RATE };
 	stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, mix_audio, nullptr);
@@ -68,180 +498,114 @@ void Sound::init() {
 	} else {
 		//start audio playback:
 		SDL_ResumeAudioStreamDevice(stream);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (up to " << max_voices << " voices, mixing with " << mix_kernel_name(mix_kernel) << ")." << std::endl;
 	}
 }
 
 
+void Sound::init_offline(uint32_t max_voices, MixKernel kernel) {
+	assert(stream == nullptr && "can't render offline while playing to the audio device");
+	if (!mix_kernel_supported(kernel)) {
+		throw std::runtime_error(std::string("Sound::init_offline: this CPU can't run the '") + mix_kernel_name(kernel) + "' mixing kernel.");
+	}
+	reset_mixer(max_voices);
+	mix_kernel = kernel;
+	offline = true;
+}
+
+void Sound::render(float *out, uint32_t frames) {
+	assert(offline && "call Sound::init_offline() before Sound::render()");
+	assert(out);
+	for (uint32_t done = 0; done < frames; done += Sound::MaxBlockFrames) {
+		mix_block(out + size_t(2) * done, std::min(frames - done, Sound::MaxBlockFrames));
+	}
+}
+
 void Sound::shutdown() {
+	offline = false;
 	if (stream != nullptr) {
 		//stop audio playback:
 		SDL_DestroyAudioStream(stream);
 		stream = nullptr;
 	}
+	if (stolen_voices) {
+		std::cout << "Audio: " << stolen_voices << " samples took the voice of a lower-priority sample." << std::endl;
+	}
 }
 
 
-void Sound::lock() {
-	if (stream) SDL_LockAudioStream(stream);
+Sound::PlayingSample Sound::play(Sample const &sample, float play_volume, float pan, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = false, .volume = play_volume, .pan = pan, .sample = &sample }, priority);
 }
 
-void Sound::unlock() {
-	if (stream) SDL_UnlockAudioStream(stream);
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = false, .volume = play_volume, .pan = std::numeric_limits< float >::quiet_NaN(), .radius = half_volume_radius, .position = position, .sample = &sample }, priority);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float play_volume, float pan, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = true, .volume = play_volume, .pan = pan, .sample = &sample }, priority);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
-}
-
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = true, .volume = play_volume, .pan = std::numeric_limits< float >::quiet_NaN(), .radius = half_volume_radius, .position = position, .sample = &sample }, priority);
 }
 
 
+Sound::PlayingSample Sound::loop(StreamingSample &sample, float play_volume, float pan, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = true, .volume = play_volume, .pan = pan, .streaming = &sample }, priority);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(StreamingSample &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, int priority) {
+	return start(Command{ .type = Command::Type::Play, .loop = true, .volume = play_volume, .pan = std::numeric_limits< float >::quiet_NaN(), .radius = half_volume_radius, .position = position, .streaming = &sample }, priority);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	send(Command{ .type = Command::Type::StopAll });
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	send(Command{ .type = Command::Type::SetVolume, .id = 0, .ramp = ramp, .volume = new_volume });
 }
 
 //------------------
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	if (id == 0) return;
+	send(Command{ .type = Command::Type::SetVolume, .id = id, .ramp = ramp, .volume = new_volume });
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	if (id == 0) return;
+	send(Command{ .type = Command::Type::SetPan, .id = id, .ramp = ramp, .pan = new_pan });
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	if (id == 0) return;
+	send(Command{ .type = Command::Type::SetPosition, .id = id, .ramp = ramp, .position = new_position });
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	if (id == 0) return;
+	send(Command{ .type = Command::Type::SetHalfVolumeRadius, .id = id, .ramp = ramp, .radius = new_radius });
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::stop(float ramp) const {
+	if (id == 0) return;
+	send(Command{ .type = Command::Type::Stop, .id = id, .ramp = ramp });
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
 	//some extra code to make sure right is always a unit vector:
-	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
-	} else {
-		right.set(glm::normalize(new_right), ramp);
-	}
-	Sound::unlock();
+	glm::vec3 right = (new_right == glm::vec3(0.0f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::normalize(new_right));
+	send(Command{ .type = Command::Type::SetListener, .ramp = ramp, .position = new_position, .right = right });
 }
 
 //------------------------ internals --------------------------------
 
 
-//helper: equal-power panning
-inline void compute_pan_weights(float pan, float *left, float *right) {
-	//clamp pan to -1 to 1 range:
-	pan = std::max(-1.0f, std::min(1.0f, pan));
-
-	//want left^2 + right^2 = 1.0, so use angles:
-	float ang = 0.5f * 3.1415926f * (0.5f * (pan + 1.0f));
-	*left = std::cos(ang);
-	*right = std::sin(ang);
-}
-
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
-	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
-
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
-	}
-}
-
 //helper: ramp updates...
 
 //helper: ...for single values:
@@ -300,24 +664,97 @@ void step_direction_ramp(float step, Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
+//helper: apply everything the game thread has asked for since the last callback:
+void apply_commands() {
+	Command command;
+	while (commands.pop(&command)) {
+		if (command.type == Command::Type::Play) {
+			assert(command.streaming || command.sample->length() != 0);
+			//the game thread picked the slot; if it still holds a voice, that voice has been stolen:
+			// (its sample fades out on a spare voice, unless all of those are busy, in which case it is just cut off)
+			uint32_t slot = slot_of(command.id);
+			uint32_t v = voices.index_of_slot[slot];
+			if (v == InvalidIndex) {
+				assert(voices.count < voices.id.size());
+				v = voices.count++;
+				voices.index_of_slot[slot] = v;
+			} else {
+				voices.fade_out(v);
+			}
+			voices.id[v] = command.id;
+			voices.sample[v] = command.sample;
+			voices.streaming[v] = command.streaming;
+			voices.i[v] = 0;
+			voices.loop[v] = command.loop;
+			voices.stopping[v] = 0;
+			voices.volume[v] = Sound::Ramp< float >(command.volume);
+			voices.pan[v] = Sound::Ramp< float >(command.pan);
+			voices.position[v] = Sound::Ramp< glm::vec3 >(command.position);
+			voices.half_volume_radius[v] = Sound::Ramp< float >(command.radius);
+		} else if (command.type == Command::Type::StopAll) {
+			for (uint32_t v = 0; v < voices.count; ++v) {
+				if (!voices.stopping[v]) {
+					voices.stopping[v] = 1;
+					voices.volume[v].set(0.0f, 1.0f / 60.0f);
+				}
+			}
+		} else if (command.type == Command::Type::SetListener) {
+			listener_position.set(command.position, command.ramp);
+			listener_right.set(command.right, command.ramp);
+		} else if (command.type == Command::Type::SetVolume && command.id == 0) {
+			volume.set(command.volume, command.ramp);
+		} else if (uint32_t v = voices.find(command.id); v != InvalidIndex) {
+			if (command.type == Command::Type::SetVolume) {
+				if (!voices.stopping[v]) voices.volume[v].set(command.volume, command.ramp);
+			} else if (command.type == Command::Type::SetPan) {
+				if (!voices.is_3D(v)) voices.pan[v].set(command.pan, command.ramp);
+			} else if (command.type == Command::Type::SetPosition) {
+				if (voices.is_3D(v)) voices.position[v].set(command.position, command.ramp);
+			} else if (command.type == Command::Type::SetHalfVolumeRadius) {
+				if (voices.is_3D(v)) voices.half_volume_radius[v].set(command.radius, command.ramp);
+			} else if (command.type == Command::Type::Stop) {
+				if (!voices.stopping[v]) {
+					voices.stopping[v] = 1;
+					voices.volume[v].target = 0.0f;
+					voices.volume[v].ramp = command.ramp;
+				} else {
+					voices.volume[v].ramp = std::min(voices.volume[v].ramp, command.ramp);
+				}
+			}
+		}
+	}
+}
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void SDLCALL mix_audio(void *, SDL_AudioStream *stream_, int additional_amount, int total_amount) {
 	if (total_amount <= 0) return;
 	assert(stream_ == stream && "callback should only be used with our main stream");
 
+	uint32_t samples = uint32_t(total_amount) / (2 * sizeof(float));
+	if (samples == 0) return;
+
+	//adapted from older code using https://github.com/libsdl-org/SDL/blob/main/docs/README-migration.md
+	//(mixed in blocks of at most Sound::MaxBlockFrames, which is as much as mix_block's scratch space holds)
+	uint32_t block = std::min(samples, Sound::MaxBlockFrames);
+	float *buffer_ = SDL_stack_alloc(float, 2 * block);
+	for (uint32_t done = 0; done < samples; done += block) {
+		uint32_t count = std::min(block, samples - done);
+		mix_block(buffer_, count);
+		SDL_PutAudioStreamData(stream, buffer_, int(count * 2 * sizeof(float)));
+	}
+	SDL_stack_free(buffer_);
+}
+
+//Mix the next block of 'samples' stereo samples into 'out' (interleaved left/right),
+// applying the game thread's commands first (used by the audio callback and by Sound::render):
+void mix_block(float *out, uint32_t samples) {
 	struct LR {
 		float l;
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
 
-	uint32_t samples = uint32_t(total_amount) / sizeof(LR);
-
-	//adapted from older code using https://github.com/libsdl-org/SDL/blob/main/docs/README-migration.md
-	int len = samples * sizeof(LR);
-	Uint8 *buffer_ = SDL_stack_alloc(Uint8, len); //this is not actually responsive to the amount of samples requested, it just mixes in blocks of MIX_SAMPLES
-
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
+	LR *buffer = reinterpret_cast< LR * >(out);
 
 	//zero the output buffer:
 	for (uint32_t s = 0; s < samples; ++s) {
@@ -325,102 +762,133 @@ void SDLCALL mix_audio(void *, SDL_AudioStream *stream_, int additional_amount,
 		buffer[s].r = 0.0f;
 	}
 
+	assert(samples <= convert_scratch.size() && "blocks can be at most Sound::MaxBlockFrames long");
+	float *converted = convert_scratch.data();
+
+	//changes from the game thread since the last block:
+	apply_commands();
+
 	//update global values:
-	float start_volume = Sound::volume.value;
-	glm::vec3 start_position =  Sound::listener.position.value;
-	glm::vec3 start_right =  Sound::listener.right.value;
+	float start_volume = volume.value;
+	glm::vec3 start_position = listener_position.value;
+	glm::vec3 start_right = listener_right.value;
 
 	const float elapsed = samples / float(AUDIO_RATE);
 
-	step_value_ramp(elapsed, Sound::volume);
-	step_position_ramp(elapsed, Sound::listener.position);
-	step_direction_ramp(elapsed, Sound::listener.right);
+	step_value_ramp(elapsed, volume);
+	step_position_ramp(elapsed, listener_position);
+	step_direction_ramp(elapsed, listener_right);
 
-	float end_volume = Sound::volume.value;
-	glm::vec3 end_position =  Sound::listener.position.value;
-	glm::vec3 end_right =  Sound::listener.right.value;
+	float end_volume = volume.value;
+	glm::vec3 end_position = listener_position.value;
+	glm::vec3 end_right = listener_right.value;
 
 	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	for (uint32_t v = 0; v < voices.count; /* later */) {
+		uint32_t &i = voices.i[v];
+		Sound::Ramp< float > &sample_volume = voices.volume[v];
+		Sound::Ramp< float > &pan = voices.pan[v];
+		Sound::Ramp< glm::vec3 > &position = voices.position[v];
+		Sound::Ramp< float > &half_volume_radius = voices.half_volume_radius[v];
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voices.is_3D(v)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
+			pan_weights_3D(
 				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				position.value,
+				half_volume_radius.value,
 				&start_pan.l, &start_pan.r);
 
-			step_position_ramp(elapsed, playing_sample.position);
-			step_value_ramp(elapsed, playing_sample.half_volume_radius);
+			step_position_ramp(elapsed, position);
+			step_value_ramp(elapsed, half_volume_radius);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			pan_weights(pan.value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(elapsed, playing_sample.pan);
+			step_value_ramp(elapsed, pan);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= start_volume * sample_volume.value;
+		start_pan.r *= start_volume * sample_volume.value;
 
-		step_value_ramp(elapsed, playing_sample.volume);
+		step_value_ramp(elapsed, sample_volume);
 
 		//..and end of the mix period:
 		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voices.is_3D(v)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
+			pan_weights_3D(
 				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				position.value,
+				half_volume_radius.value,
 				&end_pan.l, &end_pan.r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			pan_weights(pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= end_volume * sample_volume.value;
+		end_pan.r *= end_volume * sample_volume.value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
 		LR pan_step;
 		pan_step.l = (end_pan.l - start_pan.l) / samples;
 		pan_step.r = (end_pan.r - start_pan.r) / samples;
 
-		assert(playing_sample.i < playing_sample.data.size());
+		if (Sound::StreamingSample *streaming = voices.streaming[v]) {
+			//streaming samples play whatever has been decoded (and loop forever, so only finish by stopping):
+			Sound::StreamingSample::Decoder &decoder = *streaming->decoder;
+			uint32_t got = uint32_t(decoder.ring.pop(converted, samples));
+			if (got < samples) decoder.underruns.fetch_add(1, std::memory_order_relaxed);
+			mix_mono_to_stereo(mix_kernel, &buffer[0].l, converted, got, start_pan.l, start_pan.r, pan_step.l, pan_step.r);
+
+			if (voices.stopping[v] && sample_volume.value == 0.0f) {
+				if (voices.id[v] != 0) finished.push(voices.id[v]);
+				voices.remove(v);
+			} else {
+				++v;
+			}
+			continue;
+		}
 
-		for (uint32_t i = 0; i < samples; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+		Sound::Sample const &sample = *voices.sample[v];
+		uint32_t length = uint32_t(sample.length());
+		assert(i < length);
+
+		//mix in runs of contiguous sample data (so looping back to the start is handled between runs, not per sample):
+		for (uint32_t done = 0; done < samples; /* later */) {
+			uint32_t run = std::min(samples - done, length - i);
+			float const *in;
+			if (sample.data16.empty()) {
+				in = sample.data.data() + i;
+			} else {
+				pcm16_to_float(converted, sample.data16.data() + i, run);
+				in = converted;
+			}
+			mix_mono_to_stereo(mix_kernel, &buffer[done].l, in, run,
+				start_pan.l + done * pan_step.l, start_pan.r + done * pan_step.r, pan_step.l, pan_step.r);
+			done += run;
 
 			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
+			i += run;
+			if (i == length) {
+				if (voices.loop[v]) {
+					i = 0;
 				} else {
 					break;
 				}
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		if (i >= length
+		 || (voices.stopping[v] && sample_volume.value == 0.0f)) { //sample has finished
+			//hand the slot back to the game thread (unless it was a stolen sample fading out),
+			// and remove (the last voice moves to 'v', so don't advance):
+			if (voices.id[v] != 0) finished.push(voices.id[v]);
+			voices.remove(v);
 		} else {
-			++si;
+			++v;
 		}
 	}
 
@@ -429,11 +897,8 @@ void SDLCALL mix_audio(void *, SDL_AudioStream *stream_, int additional_amount,
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << voices.count << std::endl; //DEBUG
 	*/
-
-	SDL_PutAudioStreamData(stream, buffer_, len);
-	SDL_stack_free(buffer_);
 }
 
 
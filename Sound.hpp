@@ -1,7 +1,13 @@
 #pragma once
 
+#include "sound_mix.hpp"
+
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
@@ -14,15 +20,61 @@ namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//how the sample data is kept in memory:
+	enum class Format : uint8_t {
+		Float, //32-bit floating point, in 'data'
+		PCM16, //16-bit integers, in 'data16' (half the memory; the mixer converts blocks to float as it plays them)
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Format format = Format::Float);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (converted to 'format'):
+	Sample(std::vector< float > const &data, Format format = Format::Float);
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//sample data is stored as 48kHz, mono, in one of these (the other is empty):
 	std::vector< float > data;
+	std::vector< int16_t > data16;
+
+	Format format() const { return (data16.empty() ? Format::Float : Format::PCM16); }
+	//length in samples:
+	size_t length() const { return data.size() + data16.size(); }
+	//memory used by the sample data:
+	size_t bytes() const { return data.size() * sizeof(float) + data16.size() * sizeof(int16_t); }
+};
+
+//SampleBank loads each sound effect once, however many times (or places) it is asked for by the same path,
+//  and stores it compactly (16-bit, unless told otherwise):
+struct SampleBank {
+	Sample::Format format = Sample::Format::PCM16; //for samples loaded from now on
+
+	//load 'filename' (or find it, if it has already been loaded); the sample lives as long as the bank:
+	Sample const &load(std::string const &filename);
+
+	//memory used by all the samples' data:
+	size_t bytes() const;
+	//print each sample's length and memory use, and the totals (compared to storing everything as float):
+	void report(std::ostream &out) const;
+
+	std::map< std::string, std::unique_ptr< Sample > > samples; //by path
+};
+
+//StreamingSample objects play long '.opus' files (like music) without decoding them up front:
+//  a background thread decodes a little ahead of playback into a fixed-size ring,
+//  so load time and memory use don't depend on the length of the file.
+//Only 'loop' / 'loop_3D' play them, and only one voice at a time should; stopping pauses the stream,
+//  and looping it again continues from where it stopped.
+struct StreamingSample {
+	//Open a '.opus' file (throws on error) and start decoding:
+	StreamingSample(std::string const &filename);
+	~StreamingSample(); //(stops the decoding thread)
+	StreamingSample(StreamingSample const &) = delete;
+	StreamingSample &operator=(StreamingSample const &) = delete;
+
+	//internals:
+	struct Decoder; //(defined in Sound.cpp)
+	std::unique_ptr< Decoder > decoder;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,88 +100,112 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+//'PlayingSample' is a handle to a sample started by one of the play/loop functions below.
+// The audio callback owns the playing samples; the functions here queue commands for it (see Sound.cpp),
+// so they never wait on the audio thread. Once the sample has finished (or its voice has been
+// taken by a higher-priority sample), commands sent to it are ignored.
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
 
-	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	//names the sample in commands: its voice slot and that slot's generation (0: no sample):
+	uint32_t id = 0;
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//at most this many samples play at once (see 'priority', below):
+constexpr uint32_t DefaultMaxVoices = 64;
+constexpr uint32_t MaxMaxVoices = 0xffff; //(voice slots are 16 bits of a PlayingSample's id)
+
+//the mixer works in blocks of at most this many samples (longer requests are mixed as several blocks):
+constexpr uint32_t MaxBlockFrames = 4096;
+
+void init(uint32_t max_voices = DefaultMaxVoices); //call Sound::init() from main.cpp before using any member functions
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Offline rendering (for tests and benchmarks), instead of init(): no audio device is opened, and
+//  the functions below queue their commands as usual, but nothing is mixed until you call 'render',
+//  which mixes the next 'frames' samples into 'out' (2 * frames floats, interleaved left/right)
+//  and so advances playback by exactly frames / 48000 seconds.
+//  (more than MaxBlockFrames are mixed as several blocks, as if 'render' were called for each)
+//The same calls rendered in the same blocks with the same kernel always give the same output
+//  (except for streaming samples, which are decoded on their own schedule).
+void init_offline(uint32_t max_voices = DefaultMaxVoices, MixKernel kernel = MixKernel::Scalar);
+void render(float *out, uint32_t frames);
+
+//NOTE: call the functions below from one thread only (the game thread); they talk to the audio
+// callback through a single-producer/single-consumer queue.
+//
+//When all voices are busy, starting a sample takes the voice of the playing sample with the
+// lowest 'priority' (the oldest one, among equals), as long as that is no higher than the new
+// sample's priority; otherwise the new sample doesn't play, and the PlayingSample returned has id 0.
+// (the sample that lost its voice fades out over a few milliseconds rather than stopping with a click)
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  ('sample' must stay alive until it has finished playing)
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int priority = 0
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int priority = 0
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int priority = 0
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int priority = 0
+);
+
+//Loop a streaming sample (same as above; 'sample' must stay alive until it has stopped):
+PlayingSample loop(
+	StreamingSample &sample,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int priority = 0
+);
+PlayingSample loop_3D(
+	StreamingSample &sample,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int priority = 0
 );
 
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
-
-	//internals:
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f); //listener's location
-	Ramp< glm::vec3 > right = Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
 };
 extern struct Listener listener;
 
@@ -138,12 +214,5 @@ void stop_all_samples();
 
 //set global volume:
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-extern Ramp< float > volume;
-
-//the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
-void lock();
-void unlock();
 
 } //namespace Sound
@@ -0,0 +1,64 @@
+#include "SpatialHash.hpp"
+
+#include <cassert>
+#include <cmath>
+
+void SpatialHash::clear(float cell_size, size_t expected_points) {
+	assert(cell_size > 0.0f);
+	inv_cell_size = 1.0f / cell_size;
+
+	//(each point makes nine entries; about two buckets per entry keeps chains short)
+	uint32_t bucket_count = 64;
+	while (bucket_count < 2 * 9 * expected_points) bucket_count *= 2;
+	bucket_mask = bucket_count - 1;
+	buckets.assign(bucket_count, Bucket());
+
+	entries.clear();
+	entries.reserve(9 * expected_points);
+}
+
+glm::ivec2 SpatialHash::cell_of(glm::vec2 const &position) const {
+	return glm::ivec2(
+		int32_t(std::floor(position.x * inv_cell_size)),
+		int32_t(std::floor(position.y * inv_cell_size))
+	);
+}
+
+uint32_t SpatialHash::bucket_of(glm::ivec2 const &cell) const {
+	return ((uint32_t(cell.x) * 73856093u) ^ (uint32_t(cell.y) * 19349663u)) & bucket_mask;
+}
+
+void SpatialHash::insert(uint32_t index, glm::vec2 const &position) {
+	assert(!buckets.empty() && "clear() sets up the table");
+	assert((entries.empty() || entries.back().index < index) && "points are inserted by increasing index");
+
+	glm::ivec2 center = cell_of(position);
+	for (int32_t dy = -1; dy <= 1; ++dy) {
+		for (int32_t dx = -1; dx <= 1; ++dx) {
+			glm::ivec2 cell = center + glm::ivec2(dx, dy);
+			Bucket &bucket = buckets[bucket_of(cell)];
+
+			uint32_t entry = uint32_t(entries.size());
+			entries.emplace_back(Entry{ cell, position, index, Empty });
+			if (bucket.last == Empty) bucket.first = entry;
+			else entries[bucket.last].next = entry;
+			bucket.last = entry;
+		}
+	}
+}
+
+void SpatialHash::query(glm::vec2 const &position, float radius, std::vector< uint32_t > *out_) const {
+	assert(out_);
+	assert(radius * inv_cell_size <= 1.0f && "only neighboring cells are checked");
+	auto &out = *out_;
+	out.clear();
+
+	glm::ivec2 cell = cell_of(position);
+	for (uint32_t entry = buckets[bucket_of(cell)].first; entry != Empty; entry = entries[entry].next) {
+		Entry const &e = entries[entry];
+		if (e.cell != cell) continue;
+		glm::vec2 to = e.position - position;
+		if (glm::dot(to, to) > radius * radius) continue;
+		out.emplace_back(e.index);
+	}
+}
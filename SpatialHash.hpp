@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//Uniform grid over the plane, stored as a hash table of cells.
+// Points are added one at a time, by increasing index, and can be queried for all the points near a position.
+// Meant to be cleared and refilled every update.
+struct SpatialHash {
+	//remove all points; 'expected_points' sizes the table:
+	void clear(float cell_size, size_t expected_points);
+
+	//add point 'index' at 'position':
+	void insert(uint32_t index, glm::vec2 const &position);
+
+	//set 'out' to the indices of all points within 'radius' (<= cell_size) of 'position', in the order they were inserted:
+	void query(glm::vec2 const &position, float radius, std::vector< uint32_t > *out) const;
+
+	//internals:
+	// each point is listed in its own cell and the eight around it, so a query only has to read one cell's list,
+	// and because points are appended, that list is already in insertion order.
+	static constexpr uint32_t Empty = ~0u;
+	float inv_cell_size = 1.0f;
+	uint32_t bucket_mask = 0;
+	struct Bucket {
+		uint32_t first = Empty; //first entry in the bucket
+		uint32_t last = Empty; //last entry in the bucket (so insert can append)
+	};
+	std::vector< Bucket > buckets;
+	struct Entry {
+		glm::ivec2 cell; //(different cells can share a bucket)
+		glm::vec2 position; //(copied so queries can check distance without touching anything else)
+		uint32_t index; //point listed in 'cell'
+		uint32_t next; //next entry in the same bucket
+	};
+	std::vector< Entry > entries;
+
+	glm::ivec2 cell_of(glm::vec2 const &position) const;
+	uint32_t bucket_of(glm::ivec2 const &cell) const;
+};
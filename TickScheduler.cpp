@@ -0,0 +1,110 @@
+#include "TickScheduler.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <cmath>
+#include <cassert>
+
+TickScheduler::TickScheduler(Clock::duration period_, Policy const &policy_) : period(period_), policy(policy_) {
+	assert(period.count() > 0);
+}
+
+void TickScheduler::start(Clock::time_point now) {
+	next = now + period;
+	burst = 0;
+}
+
+bool TickScheduler::next_due(Clock::time_point now, Clock::time_point *scheduled) {
+	if (now < next) {
+		burst = 0;
+		return false;
+	}
+
+	//whole ticks missed beyond the one that is due:
+	uint64_t missed = uint64_t((now - next) / period);
+	if (missed > 0) {
+		uint32_t allowed = (policy.catch_up == CatchUp::Burst ? policy.max_burst : 0);
+		if (burst < allowed) {
+			//run the oldest missed tick now; the rest come on later calls:
+			burst += 1;
+		} else {
+			//give up on the missed ticks (staying on the grid, so the phase is kept):
+			skipped += missed;
+			next += period * int64_t(missed);
+		}
+	}
+
+	if (scheduled) *scheduled = next;
+	next += period;
+	return true;
+}
+
+void TickScheduler::wait_until(Clock::time_point deadline, std::function< bool(Clock::time_point until) > const &sleep) const {
+	Clock::time_point sleep_until = deadline - policy.spin;
+	while (true) {
+		Clock::time_point now = Clock::now();
+		if (now >= deadline) return;
+		if (now < sleep_until) {
+			if (sleep(sleep_until)) return;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+//-----------------------------------------
+
+void TickHistogram::add(double seconds) {
+	double us = seconds * 1e6;
+	uint32_t bucket = 0;
+	if (us >= 1.0) {
+		bucket = std::min(Buckets - 1, uint32_t(std::ilogb(us)) + 1);
+	}
+	counts[bucket] += 1;
+	count += 1;
+	total_seconds += seconds;
+	max_seconds = std::max(max_seconds, seconds);
+}
+
+void TickHistogram::merge(TickHistogram const &other) {
+	for (uint32_t b = 0; b < Buckets; ++b) {
+		counts[b] += other.counts[b];
+	}
+	count += other.count;
+	total_seconds += other.total_seconds;
+	max_seconds = std::max(max_seconds, other.max_seconds);
+}
+
+double TickHistogram::percentile(double p) const {
+	if (count == 0) return 0.0;
+	uint64_t rank = uint64_t(std::ceil(p * double(count)));
+	if (rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b < Buckets; ++b) {
+		seen += counts[b];
+		if (seen >= rank) {
+			if (b + 1 == Buckets) return max_seconds;
+			return std::min(max_seconds, std::ldexp(1.0, int32_t(b)) * 1e-6);
+		}
+	}
+	return max_seconds;
+}
+
+void TickHistogram::print_buckets(std::ostream &out) const {
+	bool first = true;
+	for (uint32_t b = 0; b < Buckets; ++b) {
+		if (counts[b] == 0) continue;
+		if (!first) out << ' ';
+		first = false;
+		out << (b == 0 ? 0 : (1u << (b - 1))) << "us:" << counts[b];
+	}
+	if (first) out << "(empty)";
+}
+
+void TickStats::merge(TickStats const &other) {
+	processing.merge(other.processing);
+	lateness.merge(other.lateness);
+	overruns += other.overruns;
+	skipped += other.skipped;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+
+//Fixed-rate tick scheduling for the server:
+// ticks are due on a fixed grid (start + k * period), so scheduling error never accumulates;
+// when a tick runs late, the catch-up policy decides whether missed ticks are run back to back or dropped.
+
+struct TickScheduler {
+	using Clock = std::chrono::steady_clock;
+
+	enum class CatchUp : uint8_t {
+		Skip, //drop missed ticks and continue from the most recent one
+		Burst, //run up to 'max_burst' missed ticks back to back, then drop the rest
+	};
+	struct Policy {
+		CatchUp catch_up = CatchUp::Burst;
+		uint32_t max_burst = 3;
+		Clock::duration spin = std::chrono::microseconds(200); //busy-wait this long before each tick instead of sleeping
+	};
+
+	TickScheduler(Clock::duration period, Policy const &policy);
+
+	Clock::duration const period;
+	Policy const policy;
+
+	//first tick is due one period after 'now':
+	void start(Clock::time_point now);
+
+	//if a tick is due at 'now', advance the schedule and return true (with the time it was due in 'scheduled'):
+	// (call repeatedly until it returns false; while behind, this is how catch-up ticks are handed out)
+	bool next_due(Clock::time_point now, Clock::time_point *scheduled);
+
+	//time the next tick is due:
+	Clock::time_point next;
+
+	//ticks dropped by the catch-up policy:
+	uint64_t skipped = 0;
+
+	//wait until 'deadline': sleeps through 'sleep' (which may return early, returning true to stop waiting)
+	// until 'spin' before the deadline, then spins the rest of the way:
+	void wait_until(Clock::time_point deadline, std::function< bool(Clock::time_point until) > const &sleep) const;
+
+	//internals:
+	uint32_t burst = 0; //catch-up ticks handed out since the schedule was last on time
+};
+
+//Log-scale histogram of durations:
+// bucket 0 counts durations under 1us, bucket b > 0 counts durations in [2^(b-1), 2^b) us; the last bucket is open-ended.
+struct TickHistogram {
+	static constexpr uint32_t Buckets = 24;
+	std::array< uint64_t, Buckets > counts{};
+	uint64_t count = 0;
+	double total_seconds = 0.0;
+	double max_seconds = 0.0;
+
+	void add(double seconds);
+	void merge(TickHistogram const &other);
+
+	//approximate duration at fraction 'p' of the samples (upper edge of the bucket it falls in):
+	double percentile(double p) const;
+
+	double mean() const { return count ? total_seconds / double(count) : 0.0; }
+
+	//print nonzero buckets as "<lower>us:<count>":
+	void print_buckets(std::ostream &out) const;
+};
+
+//Per-tick timing for something that ticks on a schedule:
+struct TickStats {
+	TickHistogram processing; //time spent in the tick
+	TickHistogram lateness; //how long after its scheduled time the tick started
+	uint64_t overruns = 0; //ticks whose processing took longer than the tick period
+	uint64_t skipped = 0; //ticks dropped by the catch-up policy
+
+	void merge(TickStats const &other);
+};
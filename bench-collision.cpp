@@ -0,0 +1,113 @@
+//Headless benchmark for Game::update's player/player collisions:
+// runs the same crowd with the spatial hash broadphase and with the brute-force pair loop,
+// reports the time per update, and checks that both give exactly the same results.
+
+#include "Game.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//random (but repeatable) inputs for every player:
+static void randomize_controls(Game &game, std::mt19937 &mt) {
+	for (auto &controls : game.players.controls) {
+		uint32_t bits = mt();
+		controls.left.pressed = (bits & 1);
+		controls.right.pressed = (bits & 2);
+		controls.up.pressed = (bits & 4);
+		controls.down.pressed = (bits & 8);
+		controls.jump.downs = 1; //everyone is ready right away
+	}
+}
+
+//do the two games hold exactly the same state?
+static bool same_state(Game const &a, Game const &b) {
+	if (a.caught_hider_count != b.caught_hider_count) return false;
+	if (a.game_state != b.game_state) return false;
+	if (a.players.size() != b.players.size()) return false;
+	size_t count = a.players.size();
+	if (std::memcmp(a.players.position.data(), b.players.position.data(), count * sizeof(glm::vec2)) != 0) return false;
+	if (std::memcmp(a.players.velocity.data(), b.players.velocity.data(), count * sizeof(glm::vec2)) != 0) return false;
+	if (a.players.is_caught != b.players.is_caught) return false;
+	return true;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t ticks = 60;
+	if (argc == 2) {
+		ticks = uint32_t(std::stoul(argv[1]));
+	} else if (argc != 1) {
+		std::cerr << "Usage:\n\t./bench-collision [ticks]" << std::endl;
+		return 1;
+	}
+
+	std::cout << std::setw(8) << "players"
+	          << std::setw(14) << "grid ms/tick"
+	          << std::setw(15) << "brute ms/tick"
+	          << std::setw(10) << "speedup"
+	          << std::setw(10) << "caught"
+	          << "  results" << std::endl;
+
+	bool all_same = true;
+	for (uint32_t count : {10, 100, 1000, 10000}) {
+		Game grid, brute;
+		brute.brute_force_collisions = true;
+		for (uint32_t i = 0; i < count; ++i) {
+			grid.spawn_player();
+			brute.spawn_player();
+		}
+
+		std::mt19937 grid_mt(0x15466), brute_mt(0x15466);
+		double grid_seconds = 0.0, brute_seconds = 0.0;
+		bool same = true;
+		for (uint32_t t = 0; t < ticks; ++t) {
+			randomize_controls(grid, grid_mt);
+			randomize_controls(brute, brute_mt);
+
+			auto before = std::chrono::steady_clock::now();
+			grid.update(Game::Tick);
+			auto between = std::chrono::steady_clock::now();
+			brute.update(Game::Tick);
+			auto after = std::chrono::steady_clock::now();
+
+			grid_seconds += std::chrono::duration< double >(between - before).count();
+			brute_seconds += std::chrono::duration< double >(after - between).count();
+
+			same = same && same_state(grid, brute);
+		}
+		all_same = all_same && same;
+
+		double grid_ms = 1000.0 * grid_seconds / ticks;
+		double brute_ms = 1000.0 * brute_seconds / ticks;
+		std::cout << std::setw(8) << count
+		          << std::fixed << std::setprecision(3)
+		          << std::setw(14) << grid_ms
+		          << std::setw(15) << brute_ms
+		          << std::setprecision(1)
+		          << std::setw(9) << (brute_ms / grid_ms) << "x"
+		          << std::setw(10) << grid.caught_hider_count
+		          << "  " << (same ? "identical" : "DIFFERENT") << std::endl;
+	}
+
+	return all_same ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
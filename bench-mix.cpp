@@ -0,0 +1,203 @@
+//Offline benchmark for the audio mixer's inner loops (sound_mix.hpp):
+// mixes many voices into a stereo block with every kernel this CPU supports,
+// reports voices mixed per millisecond, and checks each kernel's output against the scalar loop;
+// then times the 2D and 3D panning functions against their std::cos / std::sin versions and checks how far apart they are.
+
+#include "sound_mix.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t voices = 256;
+	uint32_t frames = 1024; //per block
+	uint32_t blocks = 200;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 < argc && (arg == "--voices" || arg == "--frames" || arg == "--blocks")) {
+			uint32_t value = uint32_t(std::stoul(argv[++i]));
+			if (arg == "--voices") voices = value;
+			else if (arg == "--frames") frames = value;
+			else blocks = value;
+		} else {
+			std::cerr << "Usage:\n\t./bench-mix [--voices N] [--frames N] [--blocks N]" << std::endl;
+			return 1;
+		}
+	}
+	if (voices == 0 || frames == 0 || blocks == 0) throw std::runtime_error("counts must be positive");
+
+	//one second of noise that every voice reads from (at different offsets, like different samples):
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > noise(-1.0f, 1.0f);
+	std::vector< float > data(48000);
+	for (float &d : data) d = noise(mt);
+
+	//each voice: where it reads, and its gain ramps over the block:
+	struct Voice {
+		uint32_t offset;
+		float left, right, left_step, right_step;
+	};
+	std::vector< Voice > parameters;
+	std::uniform_real_distribution< float > gain(0.0f, 1.0f);
+	for (uint32_t v = 0; v < voices; ++v) {
+		Voice voice;
+		//(odd offsets, so loads aren't all aligned)
+		voice.offset = (mt() % uint32_t(data.size() - frames)) | 1;
+		voice.left = gain(mt);
+		voice.right = gain(mt);
+		voice.left_step = (gain(mt) - voice.left) / frames;
+		voice.right_step = (gain(mt) - voice.right) / frames;
+		parameters.emplace_back(voice);
+	}
+
+	auto mix_block = [&](MixKernel kernel, std::vector< float > *out) {
+		std::fill(out->begin(), out->end(), 0.0f);
+		for (Voice const &voice : parameters) {
+			mix_mono_to_stereo(kernel, out->data(), data.data() + voice.offset, frames, voice.left, voice.right, voice.left_step, voice.right_step);
+		}
+	};
+
+	std::vector< float > reference(2 * frames);
+	mix_block(MixKernel::Scalar, &reference);
+
+	std::cout << voices << " voices, " << frames << "-frame blocks, " << blocks << " blocks:" << std::endl;
+	std::cout << std::setw(8) << "kernel"
+	          << std::setw(16) << "voices/ms"
+	          << std::setw(14) << "us/block"
+	          << std::setw(10) << "speedup"
+	          << std::setw(22) << "max diff vs scalar" << std::endl;
+
+	double scalar_rate = 0.0;
+	bool all_close = true;
+	for (MixKernel kernel : { MixKernel::Scalar, MixKernel::SSE, MixKernel::AVX2, MixKernel::NEON }) {
+		if (!mix_kernel_supported(kernel)) continue;
+
+		std::vector< float > out(2 * frames);
+		mix_block(kernel, &out); //(warm up, and check)
+		float max_diff = 0.0f;
+		for (uint32_t i = 0; i < out.size(); ++i) {
+			max_diff = std::max(max_diff, std::abs(out[i] - reference[i]));
+		}
+		//(differences come only from how the gain ramps round, so they should stay tiny next to the block's scale of about 'voices')
+		bool close = (max_diff <= 1e-5f * float(voices));
+		all_close = all_close && close;
+
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			mix_block(kernel, &out);
+		}
+		auto after = std::chrono::steady_clock::now();
+		double ms = std::chrono::duration< double, std::milli >(after - before).count();
+
+		//voices mixed per millisecond of mixing time, for a block of 'frames':
+		double rate = double(voices) * double(blocks) / ms;
+		if (kernel == MixKernel::Scalar) scalar_rate = rate;
+
+		std::cout << std::setw(8) << mix_kernel_name(kernel)
+		          << std::fixed << std::setprecision(1)
+		          << std::setw(16) << rate
+		          << std::setprecision(2)
+		          << std::setw(14) << (1000.0 * ms / blocks)
+		          << std::setprecision(1)
+		          << std::setw(9) << (rate / scalar_rate) << "x"
+		          << std::scientific << std::setprecision(2)
+		          << std::setw(22) << max_diff
+		          << (close ? "" : "  (TOO FAR)") << std::defaultfloat << std::endl;
+	}
+	std::cout << "(a " << frames << "-frame block lasts " << std::fixed << std::setprecision(2) << (1000.0 * frames / 48000.0) << " ms at 48kHz)" << std::endl;
+
+	//---- panning ----
+
+	//inputs like the mixer's: pans, and sources around a listener (some very close, some far, some with no attenuation):
+	//(few enough to stay in cache, since the mixer's are; timed over many passes)
+	constexpr uint32_t PanCalls = 4096;
+	constexpr uint32_t PanPasses = 256;
+	struct PanInput {
+		float pan;
+		glm::vec3 source;
+		float half_radius;
+	};
+	std::vector< PanInput > pan_inputs(PanCalls);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	for (PanInput &in : pan_inputs) {
+		in.pan = 1.2f * unit(mt); //(a little past the ends, to check clamping)
+		in.source = glm::vec3(unit(mt), unit(mt), unit(mt)) * (20.0f * gain(mt));
+		in.half_radius = (mt() % 8 == 0 ? std::numeric_limits< float >::infinity() : 0.5f + 10.0f * gain(mt));
+	}
+	glm::vec3 const listener_position = glm::vec3(0.5f, -0.25f, 0.0f);
+	glm::vec3 const listener_right = glm::normalize(glm::vec3(1.0f, 0.3f, 0.0f));
+
+	//time one version over all inputs; returns ns per call and stores the weights in 'out':
+	auto time_pan = [&](auto &&pan_function, std::vector< float > *out) {
+		out->resize(2 * PanCalls);
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t pass = 0; pass < PanPasses; ++pass) {
+			for (uint32_t i = 0; i < PanCalls; ++i) {
+				pan_function(pan_inputs[i], &(*out)[2*i+0], &(*out)[2*i+1]);
+			}
+		}
+		auto after = std::chrono::steady_clock::now();
+		return std::chrono::duration< double, std::nano >(after - before).count() / (double(PanCalls) * PanPasses);
+	};
+	auto pan_2D = [&](PanInput const &in, float *l, float *r) { pan_weights(in.pan, l, r); };
+	auto pan_2D_exact = [&](PanInput const &in, float *l, float *r) { pan_weights_exact(in.pan, l, r); };
+	auto pan_3D = [&](PanInput const &in, float *l, float *r) { pan_weights_3D(listener_position, listener_right, in.source, in.half_radius, l, r); };
+	auto pan_3D_exact = [&](PanInput const &in, float *l, float *r) { pan_weights_3D_exact(listener_position, listener_right, in.source, in.half_radius, l, r); };
+
+	std::cout << std::setw(8) << "panning"
+	          << std::setw(14) << "exact ns"
+	          << std::setw(14) << "fast ns"
+	          << std::setw(10) << "speedup"
+	          << std::setw(14) << "max error" << std::endl;
+	bool pans_close = true;
+	auto compare = [&](char const *name, auto &&fast, auto &&exact) {
+		std::vector< float > fast_out, exact_out;
+		time_pan(fast, &fast_out); time_pan(exact, &exact_out); //(warm up)
+		double fast_ns = time_pan(fast, &fast_out);
+		double exact_ns = time_pan(exact, &exact_out);
+		float max_error = 0.0f;
+		for (uint32_t i = 0; i < fast_out.size(); ++i) {
+			max_error = std::max(max_error, std::abs(fast_out[i] - exact_out[i]));
+		}
+		//(the weights are at most 1, so this is a relative error; the exact version itself is only float-accurate)
+		bool close = (max_error <= 2e-6f);
+		pans_close = pans_close && close;
+		std::cout << std::setw(8) << name
+		          << std::fixed << std::setprecision(2)
+		          << std::setw(14) << exact_ns
+		          << std::setw(14) << fast_ns
+		          << std::setprecision(1)
+		          << std::setw(9) << (exact_ns / fast_ns) << "x"
+		          << std::scientific << std::setprecision(2)
+		          << std::setw(14) << max_error
+		          << (close ? "" : "  (TOO FAR)") << std::defaultfloat << std::endl;
+	};
+	compare("2D", pan_2D, pan_2D_exact);
+	compare("3D", pan_3D, pan_3D_exact);
+
+	return (all_close && pans_close) ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
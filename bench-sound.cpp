@@ -0,0 +1,215 @@
+//Offline benchmark and regression check for the audio mixer (Sound::init_offline / Sound::render):
+// a scripted scene -- looping 3D voices circling a moving listener, with one-shots played now and then --
+// is rendered block by block without an audio device (with samples stored as float, or as 16-bit with --pcm16).
+// Reports the mixing cost per block for several voice counts, and a hash of a reference render
+// (made with the scalar kernel) that should only change when the mixer's output is meant to change.
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//synthetic samples for the script (so it doesn't depend on files):
+static std::vector< Sound::Sample > make_samples(Sound::Sample::Format format) {
+	std::vector< Sound::Sample > samples;
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > noise(-1.0f, 1.0f);
+	for (uint32_t k = 0; k < 8; ++k) {
+		//tones of different pitches and lengths, with a little noise and a fade at each end:
+		uint32_t length = 12000 + 6000 * k;
+		float pitch = 110.0f * float(k + 1);
+		std::vector< float > data(length);
+		for (uint32_t i = 0; i < length; ++i) {
+			float t = float(i) / 48000.0f;
+			float fade = std::min(1.0f, std::min(float(i), float(length - i)) / 480.0f);
+			data[i] = fade * (0.8f * std::sin(2.0f * 3.1415926f * pitch * t) + 0.1f * noise(mt));
+		}
+		samples.emplace_back(data, format);
+	}
+	return samples;
+}
+
+//render 'seconds' of the script with 'voices' looping voices; returns the output, and the time spent in each block:
+static std::vector< float > render_script(std::vector< Sound::Sample > const &samples, uint32_t voices, MixKernel kernel, uint32_t frames, float seconds, std::vector< double > *block_us) {
+	constexpr uint32_t OneShots = 16; //(room for the one-shots, on top of the looping voices)
+	Sound::init_offline(voices + OneShots, kernel);
+
+	std::vector< Sound::PlayingSample > loops;
+	for (uint32_t v = 0; v < voices; ++v) {
+		loops.emplace_back(Sound::loop_3D(samples[v % samples.size()], 0.5f, glm::vec3(0.0f), 4.0f, 1));
+	}
+
+	uint32_t blocks = uint32_t(std::ceil(seconds * 48000.0f / frames));
+	std::vector< float > out(size_t(2) * frames * blocks);
+	if (block_us) block_us->clear();
+
+	for (uint32_t b = 0; b < blocks; ++b) {
+		float t = float(b) * frames / 48000.0f;
+
+		//script for this block: every looping voice circles the origin at its own radius and speed...
+		for (uint32_t v = 0; v < voices; ++v) {
+			float radius = 1.0f + 0.25f * float(v % 16);
+			float angle = 0.7f * t * (1.0f + 0.1f * float(v % 7)) + 0.4f * float(v);
+			loops[v].set_position(glm::vec3(radius * std::cos(angle), radius * std::sin(angle), 0.0f), float(frames) / 48000.0f);
+		}
+		//...while the listener drifts and turns...
+		Sound::listener.set_position_right(glm::vec3(std::sin(0.3f * t), 0.0f, 0.0f), glm::vec3(std::cos(0.5f * t), std::sin(0.5f * t), 0.0f), float(frames) / 48000.0f);
+		//...and every few blocks a one-shot plays somewhere:
+		if (b % 4 == 0) {
+			Sound::play_3D(samples[b % samples.size()], 0.3f, glm::vec3(std::cos(float(b)), std::sin(float(b)), 0.0f), 2.0f);
+		}
+		if (b == blocks / 2) Sound::set_volume(0.5f, 0.1f);
+
+		auto before = std::chrono::steady_clock::now();
+		Sound::render(out.data() + size_t(2) * frames * b, frames);
+		auto after = std::chrono::steady_clock::now();
+		if (block_us) block_us->emplace_back(std::chrono::duration< double, std::micro >(after - before).count());
+	}
+
+	Sound::shutdown();
+	return out;
+}
+
+//64-bit FNV-1a of the output's bits:
+static uint64_t hash_output(std::vector< float > const &out) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (float f : out) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		for (uint32_t i = 0; i < 4; ++i) {
+			hash ^= (bits >> (8 * i)) & 0xff;
+			hash *= 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+//write stereo 48kHz 32-bit float samples as a '.wav' file:
+static void write_wav(std::string const &filename, std::vector< float > const &out) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	auto u32 = [&](uint32_t v) { file.write(reinterpret_cast< char const * >(&v), 4); };
+	auto u16 = [&](uint16_t v) { file.write(reinterpret_cast< char const * >(&v), 2); };
+	uint32_t data_bytes = uint32_t(out.size() * sizeof(float));
+	file.write("RIFF", 4); u32(36 + data_bytes); file.write("WAVE", 4);
+	file.write("fmt ", 4); u32(16);
+	u16(3); //(format: IEEE float)
+	u16(2); u32(48000); u32(48000 * 2 * 4); u16(2 * 4); u16(32);
+	file.write("data", 4); u32(data_bytes);
+	file.write(reinterpret_cast< char const * >(out.data()), data_bytes);
+	if (!file) throw std::runtime_error("Failed to write '" + filename + "'.");
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t frames = 512; //per block
+	float seconds = 4.0f;
+	MixKernel kernel = best_mix_kernel();
+	std::string wav;
+	std::string expect;
+	Sound::Sample::Format format = Sound::Sample::Format::Float;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			frames = uint32_t(std::stoul(argv[++i]));
+		} else if (arg == "--seconds" && i + 1 < argc) {
+			seconds = std::stof(argv[++i]);
+		} else if (arg == "--kernel" && i + 1 < argc) {
+			std::string name = argv[++i];
+			bool found = false;
+			for (MixKernel k : { MixKernel::Scalar, MixKernel::SSE, MixKernel::AVX2, MixKernel::NEON }) {
+				if (name == mix_kernel_name(k)) {
+					kernel = k;
+					found = true;
+				}
+			}
+			if (!found) throw std::runtime_error("Unknown kernel '" + name + "'.");
+		} else if (arg == "--wav" && i + 1 < argc) {
+			wav = argv[++i];
+		} else if (arg == "--expect" && i + 1 < argc) {
+			expect = argv[++i];
+		} else if (arg == "--pcm16") {
+			format = Sound::Sample::Format::PCM16;
+		} else {
+			std::cerr << "Usage:\n\t./bench-sound [--frames N] [--seconds S] [--kernel scalar|sse|avx2|neon] [--wav reference.wav] [--expect HASH] [--pcm16]" << std::endl;
+			return 1;
+		}
+	}
+	if (frames == 0 || !(seconds > 0.0f)) throw std::runtime_error("frames and seconds must be positive");
+
+	//---- reference render: fixed script, float samples, scalar kernel ----
+	std::vector< Sound::Sample > samples = make_samples(Sound::Sample::Format::Float);
+	constexpr uint32_t ReferenceVoices = 64;
+	std::vector< float > reference = render_script(samples, ReferenceVoices, MixKernel::Scalar, frames, seconds, nullptr);
+	std::vector< float > again = render_script(samples, ReferenceVoices, MixKernel::Scalar, frames, seconds, nullptr);
+	uint64_t hash = hash_output(reference);
+	bool repeatable = (hash_output(again) == hash && reference == again);
+
+	std::ostringstream hash_string;
+	hash_string << std::hex << std::setw(16) << std::setfill('0') << hash;
+	std::cout << "reference render (" << ReferenceVoices << " voices, " << seconds << "s in " << frames << "-frame blocks, scalar): hash " << hash_string.str()
+	          << (repeatable ? "" : "  (NOT REPEATABLE)") << std::endl;
+	bool matches = (expect.empty() || expect == hash_string.str());
+	if (!matches) std::cout << "  expected " << expect << " -- the mixer's output has changed." << std::endl;
+	if (!wav.empty()) {
+		write_wav(wav, reference);
+		std::cout << "  wrote '" << wav << "'." << std::endl;
+	}
+
+	//---- cost per block for several voice counts ----
+	if (format != Sound::Sample::Format::Float) samples = make_samples(format);
+	size_t sample_bytes = 0;
+	for (auto const &sample : samples) sample_bytes += sample.bytes();
+	double block_budget_us = 1.0e6 * frames / 48000.0;
+	std::cout << "mixing " << (format == Sound::Sample::Format::PCM16 ? "int16" : "float") << " samples (" << (sample_bytes / 1024) << " KiB) with " << mix_kernel_name(kernel) << ", " << frames << "-frame blocks (" << std::fixed << std::setprecision(1) << block_budget_us << " us of audio each):" << std::endl;
+	std::cout << std::setw(8) << "voices"
+	          << std::setw(14) << "us/block"
+	          << std::setw(14) << "max us"
+	          << std::setw(16) << "us/voice/block"
+	          << std::setw(12) << "% budget" << std::endl;
+	for (uint32_t voices : { 1u, 4u, 16u, 64u, 256u, 1024u }) {
+		std::vector< double > block_us;
+		render_script(samples, voices, kernel, frames, seconds, &block_us);
+		double total = 0.0, most = 0.0;
+		for (double us : block_us) {
+			total += us;
+			most = std::max(most, us);
+		}
+		double mean = total / block_us.size();
+		std::cout << std::setw(8) << voices
+		          << std::setprecision(2)
+		          << std::setw(14) << mean
+		          << std::setw(14) << most
+		          << std::setprecision(3)
+		          << std::setw(16) << (mean / voices)
+		          << std::setprecision(2)
+		          << std::setw(12) << (100.0 * mean / block_budget_us) << std::endl;
+	}
+
+	return (repeatable && matches) ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
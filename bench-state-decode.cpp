@@ -0,0 +1,143 @@
+//Headless benchmark for the client's state decoding (Game::recv_state_message):
+// a server-side Game runs a crowd and encodes delta states against what the client acknowledged,
+// and a client-side Game decodes them (no sockets; the bytes go straight into the client's recv_buffer).
+// Reports the time per decoded state and the heap allocations made while decoding, which should be
+// zero once the client has seen a few states (it reuses its players' storage and snapshot history).
+
+#include "Connection.hpp"
+#include "Game.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+//count heap allocations (only while 'counting' is set):
+static bool counting = false;
+static uint64_t allocations = 0;
+
+void *operator new(std::size_t size) {
+	if (counting) allocations += 1;
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+//random (but repeatable) inputs for every player:
+static void randomize_controls(Game &game, std::mt19937 &mt) {
+	for (auto &controls : game.players.controls) {
+		uint32_t bits = mt();
+		controls.left.pressed = (bits & 1);
+		controls.right.pressed = (bits & 2);
+		controls.up.pressed = (bits & 4);
+		controls.down.pressed = (bits & 8);
+		controls.jump.downs = 1; //everyone is ready right away
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t ticks = 300;
+	if (argc == 2) {
+		ticks = uint32_t(std::stoul(argv[1]));
+	} else if (argc != 1) {
+		std::cerr << "Usage:\n\t./bench-state-decode [ticks]" << std::endl;
+		return 1;
+	}
+
+	//states decoded before measuring (enough to fill the client's snapshot history):
+	constexpr uint32_t Warmup = 2 * Game::SnapshotHistory;
+	//the client acknowledges states this many ticks late (like a round trip of a couple of ticks):
+	constexpr uint32_t AckLag = 2;
+
+	std::cout << std::setw(8) << "players"
+	          << std::setw(12) << "bytes/state"
+	          << std::setw(14) << "us/decode"
+	          << std::setw(18) << "allocs/decode" << std::endl;
+
+	bool all_clean = true;
+	for (uint32_t count : {8, 64, 512}) {
+		Game server;
+		for (uint32_t i = 0; i < count; ++i) {
+			server.spawn_player();
+		}
+		Game client;
+		Connection connection;
+		std::mt19937 mt(0x15466);
+
+		std::vector< uint32_t > received; //ticks the client has decoded, for acknowledging late
+		uint64_t bytes = 0;
+		double seconds = 0.0;
+		uint64_t measured_allocations = 0;
+		for (uint32_t t = 0; t < Warmup + ticks; ++t) {
+			randomize_controls(server, mt);
+			server.update(Game::Tick);
+			server.record_snapshot();
+
+			Game::Snapshot const *baseline = nullptr;
+			if (received.size() > AckLag) baseline = server.find_snapshot(received[received.size() - 1 - AckLag]);
+			auto state = server.encode_state(baseline);
+			Game::send_state_message(&connection, 0, 0, 0, state);
+			connection.take_pending_sends(&connection.recv_buffer);
+
+			bool measure = (t >= Warmup);
+			if (measure) bytes += 4 + 10 + state->size();
+
+			allocations = 0;
+			counting = measure;
+			auto before = std::chrono::steady_clock::now();
+			bool got = client.recv_state_message(&connection);
+			auto after = std::chrono::steady_clock::now();
+			counting = false;
+			if (!got || client.tick != server.tick) throw std::runtime_error("state message not decoded");
+
+			received.emplace_back(client.tick);
+			if (measure) {
+				seconds += std::chrono::duration< double >(after - before).count();
+				measured_allocations += allocations;
+			}
+		}
+		all_clean = all_clean && measured_allocations == 0;
+
+		std::cout << std::setw(8) << count
+		          << std::setw(12) << bytes / ticks
+		          << std::fixed << std::setprecision(3)
+		          << std::setw(14) << (1e6 * seconds / ticks)
+		          << std::setw(18) << (double(measured_allocations) / ticks) << std::endl;
+	}
+
+	std::cout << (all_clean ? "no allocations in steady state" : "DECODING ALLOCATES") << std::endl;
+	return all_clean ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,133 @@
+//Headless check for player ids (IdPool.hpp): spawns and removes many players through Game::spawn_player / remove_player,
+// in random bursts (so the number of players in the game keeps rising and falling), and checks that
+// no id or handle is ever handed out twice, that the players in the game can all be found by id and handle,
+// and that ids and handles of removed players are no longer live.
+
+#include "Game.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t spawns = 100000;
+	if (argc == 2) {
+		spawns = uint32_t(std::stoul(argv[1]));
+	} else if (argc != 1) {
+		std::cerr << "Usage:\n\t./check-ids [spawns]" << std::endl;
+		return 1;
+	}
+
+	Game game;
+	std::mt19937 mt(0x15466);
+
+	struct Spawned {
+		PlayerStore::Handle handle;
+		Player::Id id;
+	};
+	std::vector< Spawned > in_game; //players currently in the game
+	std::vector< Spawned > removed; //every player removed so far
+	std::unordered_set< Player::Id > ids_seen;
+	std::unordered_set< PlayerStore::Handle > handles_seen;
+
+	uint32_t failures = 0;
+	auto check = [&](bool ok, std::string const &what) {
+		if (!ok) {
+			if (failures < 10) std::cerr << "FAILED: " << what << std::endl;
+			failures += 1;
+		}
+	};
+
+	//is a removed player gone for good?
+	auto check_stale = [&](Spawned const &s) {
+		check(!game.player_ids.is_live(s.id), "removed player's id " + std::to_string(s.id) + " is still live");
+		check(!game.players.contains(s.handle), "removed player's handle " + std::to_string(s.handle) + " is still live");
+		check(game.players.find_id(s.id) == PlayerStore::InvalidIndex, "removed player's id " + std::to_string(s.id) + " still finds a player");
+	};
+
+	//is every player in the game where its handle and id say it is?
+	auto check_in_game = [&]() {
+		check(game.players.size() == in_game.size(), "player count is " + std::to_string(game.players.size()) + ", expected " + std::to_string(in_game.size()));
+		check(game.player_ids.live_count() == in_game.size(), "live id count is " + std::to_string(game.player_ids.live_count()) + ", expected " + std::to_string(in_game.size()));
+		for (Spawned const &s : in_game) {
+			check(game.players.contains(s.handle), "handle " + std::to_string(s.handle) + " of a player in the game isn't live");
+			if (!game.players.contains(s.handle)) continue;
+			uint32_t i = game.players.index(s.handle);
+			check(game.players.handle[i] == s.handle, "handle " + std::to_string(s.handle) + " finds another player");
+			check(game.players.player_id[i] == s.id, "handle " + std::to_string(s.handle) + " finds a player with another id");
+			check(game.players.find_id(s.id) == i, "id " + std::to_string(s.id) + " finds another player");
+		}
+	};
+
+	uint32_t spawned = 0;
+	size_t most_in_game = 0;
+	while (spawned < spawns) {
+		//spawn a burst of players:
+		uint32_t burst = std::min(spawns - spawned, 1 + uint32_t(mt() % 2000));
+		for (uint32_t b = 0; b < burst; ++b) {
+			Spawned s;
+			s.handle = game.spawn_player();
+			s.id = game.players.player_id[game.players.index(s.handle)];
+			spawned += 1;
+			check(s.id != IdPool::InvalidId, "spawned player got InvalidId");
+			check(ids_seen.insert(s.id).second, "id " + std::to_string(s.id) + " handed out twice");
+			check(handles_seen.insert(s.handle).second, "handle " + std::to_string(s.handle) + " handed out twice");
+			in_game.emplace_back(s);
+		}
+		most_in_game = std::max(most_in_game, in_game.size());
+		check_in_game();
+
+		//remove a burst of randomly chosen players (sometimes everyone):
+		uint32_t leaving = (mt() % 8 == 0 ? uint32_t(in_game.size()) : uint32_t(mt() % (in_game.size() + 1)));
+		for (uint32_t l = 0; l < leaving; ++l) {
+			uint32_t pick = uint32_t(mt() % in_game.size());
+			Spawned s = in_game[pick];
+			in_game[pick] = in_game.back();
+			in_game.pop_back();
+			game.remove_player(s.handle);
+			check_stale(s);
+			removed.emplace_back(s);
+		}
+		check_in_game();
+	}
+
+	//everyone leaves; then no id or handle handed out during the run may be live:
+	while (!in_game.empty()) {
+		game.remove_player(in_game.back().handle);
+		removed.emplace_back(in_game.back());
+		in_game.pop_back();
+	}
+	check_in_game();
+	for (Spawned const &s : removed) {
+		check_stale(s);
+	}
+
+	uint32_t most_generation = 0;
+	for (Player::Id id : ids_seen) {
+		most_generation = std::max(most_generation, IdPool::generation_of(id));
+	}
+	std::cout << spawned << " players spawned and removed (at most " << most_in_game << " at once), "
+	          << game.player_ids.index_limit() << " id indices used, highest generation " << most_generation << ": "
+	          << (failures == 0 ? "ok" : std::to_string(failures) + " FAILURES") << std::endl;
+
+	return failures == 0 ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
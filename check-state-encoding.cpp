@@ -0,0 +1,215 @@
+//Headless check for state message encoding (BitStream.hpp, Game::encode_state / recv_state_message):
+// first round-trips random and edge values through each state quantizer with BitWriter / BitReader
+// (mixed with single bits and varints, so packing mistakes show up), then runs a server-side Game,
+// decodes its full and delta states into a client-side Game (no sockets), and compares the two every tick.
+// Every float must come back within its quantizer's max_error(); everything else must come back exactly.
+
+#include "Connection.hpp"
+#include "Game.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static uint32_t failures = 0;
+static void check(bool ok, std::string const &what) {
+	if (!ok) {
+		if (failures < 10) std::cerr << "FAILED: " << what << std::endl;
+		failures += 1;
+	}
+}
+
+//round-trip values through one quantizer:
+static void check_quantizer(char const *name, Quantizer const &q, std::mt19937 &mt) {
+	std::vector< float > values = {
+		q.min, q.max, 0.5f * (q.min + q.max),
+		q.min + 0.5f * q.step(), q.max - 0.5f * q.step(), //(halfway between steps)
+		std::nextafter(q.min, q.max), std::nextafter(q.max, q.min),
+	};
+	if (q.contains(0.0f)) values.emplace_back(0.0f);
+	std::uniform_real_distribution< float > in_range(q.min, q.max);
+	for (uint32_t i = 0; i < 10000; ++i) {
+		values.emplace_back(in_range(mt));
+	}
+	//(values past the ends should come back as the nearest end)
+	float span = q.max - q.min;
+	std::vector< float > outside = { q.min - span, q.min - 1e-3f * span, q.max + 1e-3f * span, q.max + span };
+
+	std::vector< uint8_t > bytes;
+	BitWriter writer(&bytes);
+	for (uint32_t k = 0; k < values.size(); ++k) {
+		writer.write_bool(k & 1);
+		q.write(writer, values[k]);
+		writer.write_varint(k * 37u);
+	}
+	for (float value : outside) {
+		q.write(writer, value);
+	}
+	writer.flush();
+
+	BitReader reader(bytes.data(), bytes.size());
+	float worst = 0.0f;
+	for (uint32_t k = 0; k < values.size(); ++k) {
+		check(reader.read_bool() == bool(k & 1), std::string(name) + ": flag before value " + std::to_string(k) + " came back wrong");
+		float got = q.read(reader);
+		worst = std::max(worst, std::abs(got - values[k]));
+		check(std::abs(got - values[k]) <= q.max_error(), std::string(name) + ": " + std::to_string(values[k]) + " came back as " + std::to_string(got));
+		check(reader.read_varint() == k * 37u, std::string(name) + ": varint after value " + std::to_string(k) + " came back wrong");
+	}
+	for (float value : outside) {
+		float got = q.read(reader);
+		float nearest = std::min(std::max(value, q.min), q.max);
+		check(std::abs(got - nearest) <= q.max_error(), std::string(name) + ": out-of-range " + std::to_string(value) + " came back as " + std::to_string(got));
+	}
+	check(reader.at_end(), std::string(name) + ": not all bytes were read");
+
+	std::cout << "  " << name << ": " << values.size() << " values, max error " << worst << " (bound " << q.max_error() << ")" << std::endl;
+}
+
+//is the client's value what the server's should arrive as?
+static void check_float(char const *what, Quantizer const &q, float server, float client) {
+	check(std::abs(server - client) <= q.max_error(), std::string(what) + ": server has " + std::to_string(server) + ", client has " + std::to_string(client));
+}
+static void check_position(Quantizer const &q, float server, float client) {
+	if (q.contains(server)) {
+		check_float("position", q, server, client);
+	} else {
+		//(outside the quantized range, positions are sent exactly)
+		check(std::memcmp(&server, &client, sizeof(float)) == 0, "out-of-range position: server has " + std::to_string(server) + ", client has " + std::to_string(client));
+	}
+}
+
+//does the client have the server's state (at wire precision)?
+static void check_same_state(Game const &server, Game const &client) {
+	using namespace StateQuantizers;
+	check(client.tick == server.tick, "client is at tick " + std::to_string(client.tick) + ", server at " + std::to_string(server.tick));
+	check(client.game_state == server.game_state, "game states differ");
+	check_float("timer", Timer, server.timer, client.timer);
+	for (uint32_t c = 0; c < 3; ++c) {
+		check_float("spotlight position", SpotlightPos, server.spotlight.pos[c], client.spotlight.pos[c]);
+		check_float("spotlight direction", SpotlightDir, server.spotlight.dir[c], client.spotlight.dir[c]);
+		check_float("spotlight energy", SpotlightEnergy, server.spotlight.energy[c], client.spotlight.energy[c]);
+	}
+	check_float("spotlight cutoff", SpotlightCutoff, server.spotlight.cutoff, client.spotlight.cutoff);
+
+	PlayerStore const &s = server.players;
+	PlayerStore const &c = client.players;
+	check(c.size() == s.size(), "client has " + std::to_string(c.size()) + " players, server has " + std::to_string(s.size()));
+	for (uint32_t i = 0; i < s.size(); ++i) {
+		uint32_t j = c.find_id(s.player_id[i]);
+		check(j != PlayerStore::InvalidIndex, "client is missing player " + std::to_string(s.player_id[i]));
+		if (j == PlayerStore::InvalidIndex) continue;
+		check_position(PositionX, s.position[i].x, c.position[j].x);
+		check_position(PositionY, s.position[i].y, c.position[j].y);
+		check_float("velocity", Velocity, s.velocity[i].x, c.velocity[j].x);
+		check_float("velocity", Velocity, s.velocity[i].y, c.velocity[j].y);
+		for (uint32_t k = 0; k < 3; ++k) {
+			check_float("color", Color, s.color[i][k], c.color[j][k]);
+		}
+		check(c.role[j] == s.role[i], "roles differ");
+		check(c.is_ready[j] == s.is_ready[i], "ready flags differ");
+		check(c.is_caught[j] == s.is_caught[i], "caught flags differ");
+		check(c.name[j] == s.name[i], "names differ ('" + s.name[i] + "' vs '" + c.name[j] + "')");
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t ticks = 300;
+	if (argc == 2) {
+		ticks = uint32_t(std::stoul(argv[1]));
+	} else if (argc != 1) {
+		std::cerr << "Usage:\n\t./check-state-encoding [ticks]" << std::endl;
+		return 1;
+	}
+
+	std::mt19937 mt(0x15466);
+
+	//---- each quantizer on its own ----
+	{
+		using namespace StateQuantizers;
+		std::cout << "quantizers:" << std::endl;
+		check_quantizer("position x", PositionX, mt);
+		check_quantizer("position y", PositionY, mt);
+		check_quantizer("velocity", Velocity, mt);
+		check_quantizer("color", Color, mt);
+		check_quantizer("spotlight position", SpotlightPos, mt);
+		check_quantizer("spotlight direction", SpotlightDir, mt);
+		check_quantizer("spotlight energy", SpotlightEnergy, mt);
+		check_quantizer("spotlight cutoff", SpotlightCutoff, mt);
+		check_quantizer("timer", Timer, mt);
+	}
+
+	//---- whole state messages ----
+	Game server;
+	for (uint32_t i = 0; i < 64; ++i) {
+		server.spawn_player();
+	}
+	Game client;
+	Connection connection;
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	uint64_t full_bytes = 0, delta_bytes = 0;
+	uint32_t deltas = 0;
+	for (uint32_t t = 0; t < ticks; ++t) {
+		for (auto &controls : server.players.controls) {
+			uint32_t bits = mt();
+			controls.left.pressed = (bits & 1);
+			controls.right.pressed = (bits & 2);
+			controls.up.pressed = (bits & 4);
+			controls.down.pressed = (bits & 8);
+			controls.jump.downs = 1; //everyone is ready right away
+		}
+		server.update(Game::Tick);
+
+		//players come and go:
+		if (t % 10 == 3) server.remove_player(server.players.handle[mt() % server.players.size()]);
+		if (t % 10 == 7) server.spawn_player();
+		//one player wanders far outside the arena (as caught players can), and one sits exactly on its edge:
+		server.players.position[0] = glm::vec2(50.0f + 0.37f * float(t), -1000.0f);
+		server.players.position[1] = glm::vec2(StateQuantizers::PositionX.max, StateQuantizers::PositionY.min);
+		//the spotlight moves now and then:
+		if (t % 5 == 0) {
+			server.spotlight.pos = 30.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+			server.spotlight.dir = glm::normalize(glm::vec3(unit(mt), unit(mt), unit(mt)) + glm::vec3(0.0f, 0.0f, -2.0f));
+			server.spotlight.energy = 64.0f * (glm::vec3(unit(mt), unit(mt), unit(mt)) + glm::vec3(1.0f));
+			server.spotlight.cutoff = 1.5f * (unit(mt) + 1.0f);
+		}
+		server.record_snapshot();
+
+		//full states to begin with and every so often, otherwise deltas against the client's latest state:
+		Game::Snapshot const *baseline = nullptr;
+		if (t % 50 != 0) baseline = server.find_snapshot(client.tick);
+		auto state = server.encode_state(baseline);
+		(baseline ? delta_bytes : full_bytes) += state->size();
+		if (baseline) deltas += 1;
+		Game::send_state_message(&connection, 0, 0, 0, state);
+		connection.take_pending_sends(&connection.recv_buffer);
+
+		if (!client.recv_state_message(&connection)) throw std::runtime_error("state message not decoded");
+		check_same_state(server, client);
+	}
+	std::cout << "state messages: " << ticks << " ticks (" << (ticks - deltas) << " full, averaging " << (full_bytes / std::max(1u, ticks - deltas))
+	          << " bytes; " << deltas << " deltas, averaging " << (delta_bytes / std::max(1u, deltas)) << " bytes)" << std::endl;
+
+	std::cout << (failures == 0 ? "ok" : std::to_string(failures) + " FAILURES") << std::endl;
+	return failures == 0 ? 0 : 1;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -36,13 +36,34 @@ int main(int argc, char **argv) {
 	try {
 #endif
 	//------------ command line arguments ------------
-	if (argc != 3) {
-		std::cerr << "Usage:\n\t./client <host> <port>" << std::endl;
+	auto usage = []() {
+		std::cerr << "Usage:\n\t./client <host> <port> [interpolation delay (ms)] [--udp] [--netsim <settings>]" << std::endl;
 		return 1;
+	};
+	if (argc < 3) return usage();
+	//how far behind the newest server state other players are drawn:
+	float interpolation_delay = 0.1f;
+	bool got_delay = false;
+	Transport transport = Transport::TCP;
+	NetSim::Settings netsim; //(see NetSim.hpp for the format)
+	for (int argi = 3; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--udp") {
+			transport = Transport::UDP;
+		} else if (arg == "--netsim" && argi + 1 < argc) {
+			netsim = NetSim::Settings::parse(argv[argi + 1]);
+			argi += 1;
+		} else if (!got_delay) {
+			interpolation_delay = std::stof(arg) / 1000.0f;
+			got_delay = true;
+		} else {
+			return usage();
+		}
 	}
 
 	//------------ connect to server --------------
-	Client client(argv[1], argv[2]);
+	Client client(argv[1], argv[2], transport);
+	client.netsim = netsim;
 
 	//------------  initialization ------------
 
@@ -113,7 +134,7 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >(client));
+	Mode::set_current(std::make_shared< PlayMode >(client, interpolation_delay));
 
 	//------------ main loop ------------
 
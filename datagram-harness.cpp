@@ -0,0 +1,222 @@
+//Loopback test of the UDP transport (Datagram.hpp) over a bad network:
+//
+// Runs a Server and a Client in one process, with the client's packets (both ways) passing through the
+// network simulator (NetSim.hpp), which drops, delays, and reorders them. The server sends a stream of numbered reliable messages and (bigger, so they
+// get fragmented) unreliable messages; the client sends reliable messages back. Checks that the reliable
+// streams arrive complete and in order, and reports how much of the unreliable traffic made it and how late.
+
+#include "Connection.hpp"
+#include "Datagram.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr char const *DefaultNetSim = "delay=30,jitter=20,loss=5";
+
+//test messages (on either channel):
+// [u32 sequence][f64 send time][u16 padding size][padding]
+static void append_message(std::vector< uint8_t > *out_, uint32_t sequence, double now, uint16_t padding) {
+	auto &out = *out_;
+	size_t at = out.size();
+	out.resize(at + 4 + 8 + 2 + padding, uint8_t(sequence));
+	memcpy(out.data() + at, &sequence, 4);
+	memcpy(out.data() + at + 4, &now, 8);
+	memcpy(out.data() + at + 12, &padding, 2);
+}
+
+//pull complete messages out of 'buffer', calling 'got(sequence, send time)' for each:
+template< typename Got >
+static void read_messages(ByteQueue &buffer, Got const &got) {
+	while (buffer.size() >= 14) {
+		uint32_t sequence;
+		double sent;
+		uint16_t padding;
+		memcpy(&sequence, buffer.data(), 4);
+		memcpy(&sent, buffer.data() + 4, 8);
+		memcpy(&padding, buffer.data() + 12, 2);
+		if (buffer.size() < 14 + size_t(padding)) break;
+		for (uint32_t i = 0; i < padding; ++i) {
+			if (buffer[14 + i] != uint8_t(sequence)) throw std::runtime_error("corrupt message " + std::to_string(sequence));
+		}
+		buffer.consume(14 + padding);
+		got(sequence, sent);
+	}
+}
+
+static double percentile(std::vector< double > sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	std::sort(sorted.begin(), sorted.end());
+	size_t at = size_t(p * double(sorted.size() - 1) + 0.5);
+	return sorted[std::min(at, sorted.size() - 1)];
+}
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./datagram-harness [--netsim SETTINGS] [--seconds S] [--rate HZ] [--size BYTES] [--port N]\n"
+		          << "\t  --netsim: network conditions in each direction (default '" << DefaultNetSim << "'; see NetSim.hpp)\n"
+		          << "\t  --size: bytes in each unreliable message (default 3000, so they need three packets)\n"
+		          << "\t  --port: server port (default 15480)" << std::endl;
+		return 1;
+	};
+
+	NetSim::Settings netsim = NetSim::Settings::parse(DefaultNetSim);
+	double seconds = 5.0;
+	double rate = 30.0;
+	uint32_t size = 3000;
+	uint16_t port = 15480;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) return usage();
+		std::string value = argv[++i];
+		if (arg == "--netsim") netsim = NetSim::Settings::parse(value);
+		else if (arg == "--seconds") seconds = std::stod(value);
+		else if (arg == "--rate") rate = std::stod(value);
+		else if (arg == "--size") size = uint32_t(std::stoul(value));
+		else if (arg == "--port") port = uint16_t(std::stoul(value));
+		else return usage();
+	}
+	if (size < 14 || size > 14 + 0xffff || !(rate > 0.0)) return usage();
+
+	Clock::time_point start = Clock::now();
+	auto now_seconds = [&]() {
+		return std::chrono::duration< double >(Clock::now() - start).count();
+	};
+
+	std::cout << "Network: " << netsim.to_string() << "; "
+	          << seconds << "s at " << rate << "Hz, " << size << "-byte unreliable messages." << std::endl;
+
+	//------------ server (on its own thread, since the client's constructor blocks) ------------
+
+	Server server(std::to_string(port), Transport::UDP);
+
+	std::atomic< bool > stop(false);
+	std::atomic< bool > sending(true);
+	std::atomic< uint32_t > server_sent(0); //messages sent on each channel
+	std::atomic< uint32_t > server_received(0); //reliable messages from the client
+	bool server_in_order = true;
+	DatagramLink server_link; //(stats copied at the end)
+
+	//(all of the above is shared with the client below; the rest only once the thread is done)
+	std::thread server_thread([&]() {
+		double next_send = 0.0;
+		std::vector< uint8_t > reliable;
+		while (!stop) {
+			server.poll([&](Connection *c, Connection::Event evt) {
+				if (evt != Connection::OnRecv) return;
+				read_messages(c->recv_buffer, [&](uint32_t sequence, double) {
+					if (sequence != server_received) server_in_order = false;
+					server_received += 1;
+				});
+			}, 0.001);
+
+			double now = now_seconds();
+			if (sending && now >= next_send && !server.connections.empty()) {
+				next_send = now + 1.0 / rate;
+				Connection &c = server.connections.front();
+				reliable.clear();
+				append_message(&reliable, server_sent, now, 50);
+				c.send_raw(reliable.data(), reliable.size());
+				auto body = std::make_shared< std::vector< uint8_t > >();
+				append_message(body.get(), server_sent, now, uint16_t(size - 14));
+				c.send_unreliable(nullptr, 0, body);
+				server_sent += 1;
+			}
+		}
+		if (!server.connections.empty()) {
+			DatagramLink const &link = *server.connections.front().datagram;
+			server_link.packets_sent = link.packets_sent;
+			server_link.retransmits = link.retransmits;
+			server_link.rtt = link.rtt;
+		}
+	});
+
+	//------------ client ------------
+
+	uint32_t reliable_received = 0;
+	bool reliable_in_order = true;
+	std::vector< double > reliable_latency;
+	uint32_t unreliable_received = 0;
+	uint32_t unreliable_late = 0; //arrived after a newer one
+	uint32_t unreliable_newest = 0;
+	std::vector< double > unreliable_latency;
+	uint32_t client_sent = 0;
+
+	try {
+		Client client("127.0.0.1", std::to_string(port), Transport::UDP);
+		client.netsim = netsim;
+
+		double end = now_seconds() + seconds;
+		double next_send = 0.0;
+		std::vector< uint8_t > reliable;
+		//send for 'seconds', then give the reliable streams a few seconds to finish:
+		while (now_seconds() < end + 5.0) {
+			double now = now_seconds();
+			if (now >= end) {
+				sending = false;
+				if (reliable_received == server_sent && server_received == client_sent) break;
+			}
+			if (now < end && now >= next_send) {
+				next_send = now + 1.0 / rate;
+				reliable.clear();
+				append_message(&reliable, client_sent, now, 20);
+				client.connection.send_raw(reliable.data(), reliable.size());
+				client_sent += 1;
+			}
+			client.poll([&](Connection *c, Connection::Event evt) {
+				if (evt == Connection::OnClose) throw std::runtime_error("connection closed");
+				if (evt != Connection::OnRecv) return;
+				double arrival = now_seconds();
+				read_messages(c->recv_buffer, [&](uint32_t sequence, double sent) {
+					if (sequence != reliable_received) reliable_in_order = false;
+					reliable_received += 1;
+					reliable_latency.emplace_back(arrival - sent);
+				});
+				read_messages(c->unreliable_recv_buffer, [&](uint32_t sequence, double sent) {
+					if (unreliable_received > 0 && sequence < unreliable_newest) unreliable_late += 1;
+					unreliable_newest = std::max(unreliable_newest, sequence);
+					unreliable_received += 1;
+					unreliable_latency.emplace_back(arrival - sent);
+				});
+			}, 0.001);
+		}
+
+		DatagramLink const &link = *client.connection.datagram;
+		stop = true;
+		server_thread.join();
+
+		//------------ report ------------
+		std::cout << std::fixed << std::setprecision(1);
+		auto ms = [](double s) { return s * 1000.0; };
+		std::cout << "reliable (server -> client): " << reliable_received << " of " << server_sent << " messages, "
+		          << (reliable_in_order ? "in order" : "OUT OF ORDER")
+		          << "; latency ms p50 " << ms(percentile(reliable_latency, 0.5)) << " p99 " << ms(percentile(reliable_latency, 0.99)) << " max " << ms(percentile(reliable_latency, 1.0)) << std::endl;
+		std::cout << "reliable (client -> server): " << server_received << " of " << client_sent << " messages, "
+		          << (server_in_order ? "in order" : "OUT OF ORDER") << std::endl;
+		std::cout << "unreliable (server -> client): " << unreliable_received << " of " << server_sent << " messages ("
+		          << (server_sent ? 100.0 * double(unreliable_received) / double(server_sent) : 0.0) << "%), " << unreliable_late << " after a newer one, "
+		          << link.unreliable_dropped << " partly received"
+		          << "; latency ms p50 " << ms(percentile(unreliable_latency, 0.5)) << " p99 " << ms(percentile(unreliable_latency, 0.99)) << " max " << ms(percentile(unreliable_latency, 1.0)) << std::endl;
+		std::cout << "packets: server sent " << server_link.packets_sent << " (" << server_link.retransmits << " go-backs), client sent " << link.packets_sent << " (" << link.retransmits << " go-backs); "
+		          << "simulator dropped " << (client.connection.netsim_send ? client.connection.netsim_send->dropped : 0) << " sent, "
+		          << (client.connection.netsim_recv ? client.connection.netsim_recv->dropped : 0) << " received; rtt estimate " << ms(link.rtt) << "ms" << std::endl;
+
+		bool ok = reliable_in_order && server_in_order && reliable_received == server_sent && server_received == client_sent;
+		std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+		return ok ? 0 : 1;
+	} catch (std::exception const &e) {
+		std::cerr << "[datagram-harness] " << e.what() << std::endl;
+		stop = true;
+		server_thread.join();
+		return 1;
+	}
+}
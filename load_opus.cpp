@@ -2,8 +2,8 @@
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
-#include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
@@ -15,40 +15,78 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << "loading '" << filename << "'..."; std::cout.flush();
 
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
-	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
-		op_open_file(filename.c_str(), &err), //pointer to hold
-		op_free //deletion function
-	);
-	if (err != 0) {
-		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
-	}
+	OpusReader reader(filename);
 
 	//get length in samples:
-	ogg_int64_t length = op_pcm_total(op.get(), -1);
+	int64_t length = reader.length();
 	if (length >= 0) {
-		data.reserve(length);
+		data.reserve(size_t(length));
 	} else {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
 		data.reserve(2*48000);
 	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
+	//decode straight into the end of data, filling the reserved space before growing it:
+	constexpr uint32_t Chunk = 48000;
 	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		size_t at = data.size();
+		if (at == data.capacity()) {
+			//(reservation is full -- most likely the file is done, so check before growing)
+			float next = 0.0f;
+			if (reader.read(&next, 1) == 0) break;
+			data.emplace_back(next);
+			continue;
 		}
+		uint32_t count = uint32_t(std::min< size_t >(data.capacity() - at, Chunk));
+		data.resize(at + count);
+		uint32_t got = reader.read(data.data() + at, count);
+		data.resize(at + got);
+		if (got == 0) break;
 	}
 
 	std::cout << " done." << std::endl;
 }
+
+OpusReader::OpusReader(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || op == nullptr) {
+		if (op) op_free(op);
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	pcm.resize(2*5760); //(the longest opus packet is 120ms, or 5760 samples)
+}
+
+OpusReader::~OpusReader() {
+	op_free(op);
+}
+
+int64_t OpusReader::length() const {
+	ogg_int64_t length = op_pcm_total(op, -1);
+	return (length >= 0 ? int64_t(length) : -1);
+}
+
+uint32_t OpusReader::read(float *data, uint32_t count) {
+	uint32_t done = 0;
+	while (done < count) {
+		//(asks for no more than fits in 'data', so decoded samples are never left over)
+		int ret = op_read_float_stereo(op, pcm.data(), int(2 * std::min< uint32_t >(count - done, uint32_t(pcm.size() / 2))));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		if (ret == 0) break; //end of file
+		//ret is the number of samples read per channel; downmix to mono by averaging:
+		for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+			data[done + i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+		}
+		done += uint32_t(ret);
+	}
+	return done;
+}
+
+void OpusReader::rewind() {
+	int ret = op_pcm_seek(op, 0);
+	if (ret != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+	}
+}
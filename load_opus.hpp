@@ -2,6 +2,30 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+
+struct OggOpusFile; //(from opusfile.h)
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//Decode an opus file a piece at a time, as 48kHz floating-point mono (used by load_opus and for streaming):
+struct OpusReader {
+	//open the file; throws on error:
+	OpusReader(std::string const &filename);
+	~OpusReader();
+	OpusReader(OpusReader const &) = delete;
+	OpusReader &operator=(OpusReader const &) = delete;
+
+	//decode up to 'count' samples into 'data'; returns the number decoded (0 only at the end of the file); throws on error:
+	uint32_t read(float *data, uint32_t count);
+	//go back to the start of the file; throws on error:
+	void rewind();
+
+	//length of the file in samples, or -1 if it can't be determined:
+	int64_t length() const;
+
+	std::string filename;
+	OggOpusFile *op = nullptr;
+	std::vector< float > pcm; //(scratch for decoded stereo samples)
+};
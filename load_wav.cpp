@@ -8,10 +8,8 @@
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
-void load_wav(std::string const &filename, std::vector< float > *data_) {
-	assert(data_);
-	auto &data = *data_;
-
+//load 'filename' and convert it (if needed) to 48kHz mono 'format'; the returned buffer must be freed with SDL_free:
+static void load_converted(std::string const &filename, SDL_AudioFormat format, std::string const &format_name, Uint8 **audio_buf_, Uint32 *audio_len_) {
 	SDL_AudioSpec audio_spec;
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
@@ -19,11 +17,11 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	if (!SDL_LoadWAV(filename.c_str(), &audio_spec, &audio_buf, &audio_len)) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
-	SDL_AudioSpec out_spec{ .format=SDL_AUDIO_F32, .channels=1, .freq=AUDIO_RATE };
+	SDL_AudioSpec out_spec{ .format=format, .channels=1, .freq=AUDIO_RATE };
 	if (audio_spec.format != out_spec.format || audio_spec.channels != out_spec.channels || audio_spec.freq != out_spec.freq) {
 		Uint8 *out_buf = NULL;
 		int out_len = 0;
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, " + format_name + ", mono; converting." << std::endl;
 
 		if (!SDL_ConvertAudioSamples(&audio_spec, audio_buf, audio_len, &out_spec, &out_buf, &out_len)) {
 			//shouldn't happen, but if it does treat as fatal
@@ -39,6 +37,31 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		audio_len = out_len;
 	}
 
+	*audio_buf_ = audio_buf;
+	*audio_len_ = audio_len;
+}
+
+void load_wav(std::string const &filename, std::vector< int16_t > *data_) {
+	assert(data_);
+	auto &data = *data_;
+
+	Uint8 *audio_buf = nullptr;
+	Uint32 audio_len = 0;
+	load_converted(filename, SDL_AUDIO_S16, "int16", &audio_buf, &audio_len);
+
+	data.assign(reinterpret_cast< int16_t * >(audio_buf), reinterpret_cast< int16_t * >(audio_buf + audio_len));
+
+	SDL_free(audio_buf);
+}
+
+void load_wav(std::string const &filename, std::vector< float > *data_) {
+	assert(data_);
+	auto &data = *data_;
+
+	Uint8 *audio_buf = nullptr;
+	Uint32 audio_len = 0;
+	load_converted(filename, SDL_AUDIO_F32, "float32", &audio_buf, &audio_len);
+
 	data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
 
 	SDL_free(audio_buf);
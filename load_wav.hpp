@@ -2,6 +2,10 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 //Load a WAV file as 48kHz floating-point mono; throws on error:
 void load_wav(std::string const &filename, std::vector< float > *data);
+
+//Load a WAV file as 48kHz 16-bit mono (converting straight from the file's format); throws on error:
+void load_wav(std::string const &filename, std::vector< int16_t > *data);
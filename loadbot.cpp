@@ -0,0 +1,326 @@
+//Headless load generator: connects many simulated players to a server and measures what they get back.
+//
+// Each bot is a full network client (Client + Game::recv_state_message + Player::Controls) without any
+// window, rendering, or audio, so one process can drive thousands of players over loopback.
+// Run a few of these side by side to go beyond what one process can poll.
+
+#include "Connection.hpp"
+#include "Game.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+//one simulated player:
+struct Bot {
+	std::unique_ptr< Client > client;
+	Game game;
+	Player::Controls controls;
+	Player::Controls sent_controls; //last controls sent (like the real client, bots only send changes and heartbeats)
+	uint32_t controls_sequence = 0; //(numbers each controls message)
+	double next_heartbeat = 0.0;
+	bool closed = false;
+
+	//random inputs: hold the current directions until this time
+	double next_change = 0.0;
+
+	//one-way delay estimate for each state message: arrival time minus server tick time (seconds);
+	// only differences matter, since the server and bot clocks have different origins:
+	std::vector< double > delays;
+};
+
+enum class Inputs {
+	Random, //each bot holds a random direction for a random time
+	Script, //each bot walks the same repeating pattern (offset by bot index), so runs are repeatable
+};
+
+//value at fraction 'p' of the sorted samples:
+static double percentile(std::vector< double > const &sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	size_t at = size_t(p * double(sorted.size() - 1) + 0.5);
+	return sorted[std::min(at, sorted.size() - 1)];
+}
+
+static void set_inputs(Bot &bot, uint32_t index, Inputs inputs, double now, std::mt19937 &mt) {
+	Player::Controls &c = bot.controls;
+	if (inputs == Inputs::Random) {
+		if (now < bot.next_change) return;
+		uint32_t bits = mt();
+		c.left.pressed = (bits & 1);
+		c.right.pressed = (bits & 2) && !(bits & 1);
+		c.up.pressed = (bits & 4);
+		c.down.pressed = (bits & 8) && !(bits & 4);
+		bot.next_change = now + std::uniform_real_distribution< double >(0.25, 2.0)(mt);
+	} else { assert(inputs == Inputs::Script);
+		//walk a square, one side per second:
+		uint32_t side = (uint32_t(now) + index) % 4;
+		c.right.pressed = (side == 0);
+		c.up.pressed = (side == 1);
+		c.left.pressed = (side == 2);
+		c.down.pressed = (side == 3);
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./loadbot <host> <port> [--bots N] [--seconds S] [--warmup S] [--rate HZ] [--inputs random|script] [--seed N] [--udp] [--netsim SETTINGS]" << std::endl;
+		return 1;
+	};
+
+	if (argc < 3) return usage();
+	std::string host = argv[1];
+	std::string port = argv[2];
+
+	uint32_t bot_count = 100;
+	double seconds = 30.0; //measured run time
+	double warmup = 2.0; //time after connecting before measuring (lets backlogs from the connect phase drain)
+	double rate = 60.0; //frames per second per bot (each frame sends controls if they changed, like the client)
+	Inputs inputs = Inputs::Random;
+	uint32_t seed = 0x15466;
+	Transport transport = Transport::TCP;
+	NetSim::Settings netsim; //(applied to every bot; see NetSim.hpp)
+
+	for (int i = 3; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--udp") {
+			transport = Transport::UDP;
+			continue;
+		}
+		if (i + 1 >= argc) return usage();
+		std::string value = argv[++i];
+		if (arg == "--bots") bot_count = uint32_t(std::stoul(value));
+		else if (arg == "--seconds") seconds = std::stod(value);
+		else if (arg == "--warmup") warmup = std::stod(value);
+		else if (arg == "--rate") rate = std::stod(value);
+		else if (arg == "--seed") seed = uint32_t(std::stoul(value));
+		else if (arg == "--netsim") netsim = NetSim::Settings::parse(value);
+		else if (arg == "--inputs") {
+			if (value == "random") inputs = Inputs::Random;
+			else if (value == "script") inputs = Inputs::Script;
+			else return usage();
+		}
+		else return usage();
+	}
+	if (bot_count == 0 || !(rate > 0.0)) return usage();
+
+	#if defined(__linux__) || defined(__APPLE__)
+	{ //each bot needs a socket (and, with epoll, an epoll fd), so raise the open file limit as far as allowed:
+		struct rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+	#endif
+
+	//------------ bots ------------
+
+	std::mt19937 mt(seed);
+	std::vector< Bot > bots(bot_count);
+
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point start = Clock::now();
+	auto now_seconds = [&]() {
+		return std::chrono::duration< double >(Clock::now() - start).count();
+	};
+
+	//measurement window (set once every bot has connected):
+	double measure_begin = 1e30;
+	double measure_end = 1e30;
+
+	//totals over the measurement window:
+	uint64_t snapshots = 0;
+	uint64_t bytes_received = 0;
+	uint64_t bytes_sent = 0;
+	uint32_t disconnects = 0;
+	uint32_t errors = 0;
+	std::vector< double > decode_seconds; //time spent in each successful recv_state_message
+
+	//receive everything waiting for one bot:
+	auto poll_bot = [&](Bot &bot) {
+		if (bot.closed) return;
+		//(state messages arrive in recv_buffer over TCP and in unreliable_recv_buffer over UDP)
+		uint64_t recv_before = bot.client->connection.recv_buffer.consumed + bot.client->connection.unreliable_recv_buffer.consumed;
+		uint64_t send_before = bot.client->connection.send_buffer.consumed;
+		bot.client->poll([&](Connection *c, Connection::Event event) {
+			if (event == Connection::OnClose) {
+				bot.closed = true;
+				++disconnects;
+			} else if (event == Connection::OnRecv) {
+				double arrival = now_seconds();
+				bool measuring = (arrival >= measure_begin && arrival < measure_end);
+				bool got_state = false;
+				try {
+					while (true) {
+						auto before = Clock::now();
+						if (!bot.game.recv_state_message(c)) break;
+						auto after = Clock::now();
+						got_state = true;
+						if (measuring) {
+							++snapshots;
+							decode_seconds.emplace_back(std::chrono::duration< double >(after - before).count());
+							bot.delays.emplace_back(arrival - double(bot.game.tick) * double(Game::Tick));
+						}
+					}
+					if (got_state) StateAck{ bot.game.tick }.send_ack_message(c);
+				} catch (std::exception const &e) {
+					std::cerr << "[loadbot] malformed message from server: " << e.what() << std::endl;
+					++errors;
+					c->close();
+					bot.closed = true;
+				}
+			}
+		}, 0.0);
+		double now = now_seconds();
+		if (now >= measure_begin && now < measure_end) {
+			bytes_received += bot.client->connection.recv_buffer.consumed + bot.client->connection.unreliable_recv_buffer.consumed - recv_before;
+			bytes_sent += bot.client->connection.send_buffer.consumed - send_before;
+		}
+	};
+
+	{ //connect every bot (quietly -- Client::Client narrates each attempt), polling the ones already connected:
+		std::cout << "Connecting " << bot_count << " bots to " << host << ":" << port << "..." << std::endl;
+		std::ostringstream discard;
+		for (uint32_t i = 0; i < bot_count; ++i) {
+			std::streambuf *old = std::cout.rdbuf(discard.rdbuf());
+			try {
+				bots[i].client = std::make_unique< Client >(host, port, transport);
+				bots[i].client->netsim = netsim;
+			} catch (...) {
+				std::cout.rdbuf(old);
+				std::cerr << "[loadbot] failed to connect bot " << i << ":\n" << discard.str();
+				throw;
+			}
+			std::cout.rdbuf(old);
+			discard.str("");
+
+			//everyone readies up right away:
+			bots[i].controls.jump.downs = 1;
+			bots[i].controls.send_controls_message(&bots[i].client->connection, ++bots[i].controls_sequence);
+			bots[i].controls.jump.downs = 0;
+
+			if (i % 64 == 63) {
+				for (uint32_t b = 0; b <= i; ++b) poll_bot(bots[b]);
+			}
+		}
+		measure_begin = now_seconds() + warmup;
+		measure_end = measure_begin + seconds;
+		std::cout << "Connected in " << std::fixed << std::setprecision(2) << now_seconds() << "s; measuring for " << seconds << "s after " << warmup << "s of warmup." << std::endl;
+	}
+
+	//------------ main loop ------------
+	// bots run 'rate' frames per second but are polled as often as possible,
+	// so that arrival times aren't rounded to the frame rate.
+
+	double frame_interval = 1.0 / rate;
+	double next_frame = now_seconds();
+	double pass_max = 0.0; //longest pass over all bots (if this gets near a tick, the bots themselves are the bottleneck)
+
+	while (true) {
+		double now = now_seconds();
+		if (now >= measure_end) break;
+
+		auto pass_begin = Clock::now();
+		bool new_frame = (now >= next_frame);
+		if (new_frame) {
+			next_frame += frame_interval;
+			if (next_frame < now) next_frame = now + frame_interval; //don't burst if we fell behind
+		}
+		for (uint32_t i = 0; i < bot_count; ++i) {
+			Bot &bot = bots[i];
+			if (bot.closed) continue;
+			if (new_frame) {
+				set_inputs(bot, i, inputs, now, mt);
+				if (bot.controls.changed_since(bot.sent_controls) || now >= bot.next_heartbeat) {
+					bot.controls.send_controls_message(&bot.client->connection, ++bot.controls_sequence);
+					bot.sent_controls = bot.controls;
+					bot.next_heartbeat = now + Game::ControlsHeartbeat;
+				}
+				bot.controls.left.downs = 0;
+				bot.controls.right.downs = 0;
+				bot.controls.up.downs = 0;
+				bot.controls.down.downs = 0;
+				bot.controls.jump.downs = 0;
+			}
+			poll_bot(bot);
+		}
+		double pass = std::chrono::duration< double >(Clock::now() - pass_begin).count();
+		if (now >= measure_begin) pass_max = std::max(pass_max, pass);
+
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+
+	//------------ report ------------
+
+	//delay relative to each bot's fastest state message, so the (unknown) clock offset cancels:
+	std::vector< double > latencies;
+	latencies.reserve(snapshots);
+	for (Bot const &bot : bots) {
+		if (bot.delays.empty()) continue;
+		double fastest = *std::min_element(bot.delays.begin(), bot.delays.end());
+		for (double d : bot.delays) latencies.emplace_back(d - fastest);
+	}
+	std::sort(latencies.begin(), latencies.end());
+	std::sort(decode_seconds.begin(), decode_seconds.end());
+
+	double decode_total = 0.0;
+	for (double d : decode_seconds) decode_total += d;
+
+	uint32_t alive = 0;
+	for (Bot const &bot : bots) {
+		if (!bot.closed) ++alive;
+	}
+
+	std::cout << std::fixed;
+	std::cout << "bots: " << alive << " connected of " << bot_count << " (" << disconnects << " disconnected, " << errors << " malformed)\n";
+	std::cout << std::setprecision(1);
+	std::cout << "snapshots: " << snapshots << " (" << double(snapshots) / seconds << "/s total, " << double(snapshots) / seconds / bot_count << "/s per bot)\n";
+	std::cout << "received: " << double(bytes_received) / seconds / 1024.0 << " KiB/s total, " << double(bytes_received) / seconds / bot_count << " B/s per bot\n";
+	std::cout << "sent: " << double(bytes_sent) / seconds / 1024.0 << " KiB/s total, " << double(bytes_sent) / seconds / bot_count << " B/s per bot\n";
+	std::cout << std::setprecision(3);
+	std::cout << "snapshot latency (ms, relative to each bot's fastest):"
+		<< " p50 " << 1000.0 * percentile(latencies, 0.50)
+		<< " p90 " << 1000.0 * percentile(latencies, 0.90)
+		<< " p99 " << 1000.0 * percentile(latencies, 0.99)
+		<< " p99.9 " << 1000.0 * percentile(latencies, 0.999)
+		<< " max " << (latencies.empty() ? 0.0 : 1000.0 * latencies.back()) << "\n";
+	std::cout << "decode (us per state message):"
+		<< " mean " << (decode_seconds.empty() ? 0.0 : 1e6 * decode_total / double(decode_seconds.size()))
+		<< " p50 " << 1e6 * percentile(decode_seconds, 0.50)
+		<< " p99 " << 1e6 * percentile(decode_seconds, 0.99)
+		<< " max " << (decode_seconds.empty() ? 0.0 : 1e6 * decode_seconds.back()) << "\n";
+	std::cout << "bot loop: longest pass " << 1000.0 * pass_max << " ms";
+	if (pass_max > 0.5 * double(Game::Tick)) std::cout << " (bots may be limiting the measurement; use more processes)";
+	std::cout << std::endl;
+
+	return (errors == 0 ? 0 : 1);
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -4,12 +4,23 @@
 #include "hex_dump.hpp"
 
 #include "Game.hpp"
+#include "RoomManager.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
+#include <string>
+#include <mutex>
+
+//players per room (unless set with --room-size):
+static constexpr uint32_t DefaultRoomSize = 8;
+//longest the network thread waits for socket activity (rooms wake it as soon as they queue state messages):
+static constexpr double PollSeconds = 1.0;
+//how often to print room tick timing:
+static constexpr uint32_t ReportSeconds = 10;
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -32,87 +43,165 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	auto usage = [&]() {
+		TickScheduler::Policy defaults;
+		std::cerr << "Usage:\n\t./server <port> [--workers <count>] [--room-size <players>] [--catch-up skip|<ticks>] [--spin-us <us>] [--udp] [--netsim <settings>] [--no-interest] [--interest-budget <players>]\n"
+		          << "\t  --workers: threads that run rooms (default: one per core)\n"
+		          << "\t  --room-size: most players per room (default: " << DefaultRoomSize << ")\n"
+		          << "\t  --catch-up: when behind, drop missed ticks ('skip') or run up to <ticks> of them back to back (default: " << defaults.max_burst << ")\n"
+		          << "\t  --spin-us: busy-wait this long before each tick instead of sleeping (default: " << std::chrono::duration_cast< std::chrono::microseconds >(defaults.spin).count() << ")\n"
+		          << "\t  --udp: talk to clients over UDP (state messages unreliable) instead of TCP\n"
+		          << "\t  --netsim: simulate network conditions on every connection, e.g. 'delay=40,jitter=10,loss=1' (see NetSim.hpp)\n"
+		          << "\t  --no-interest: send every client every player every tick, instead of only relevant ones, less often when far away (see Interest.hpp)\n"
+		          << "\t  --interest-budget: most far-away players updated in each state message (default: no limit)" << std::endl;
+	};
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string port = argv[1];
+	uint32_t workers = 0;
+	uint32_t room_size = DefaultRoomSize;
+	TickScheduler::Policy policy;
+	Transport transport = Transport::TCP;
+	NetSim::Settings netsim;
+	Interest::Settings interest;
+	for (int argi = 2; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--udp") {
+			transport = Transport::UDP;
+		} else if (arg == "--no-interest") {
+			interest.enabled = false;
+		} else if (arg == "--netsim" && argi + 1 < argc) {
+			netsim = NetSim::Settings::parse(argv[argi + 1]);
+			argi += 1;
+		} else if (arg == "--catch-up" && argi + 1 < argc) {
+			std::string value = argv[argi + 1];
+			if (value == "skip") {
+				policy.catch_up = TickScheduler::CatchUp::Skip;
+			} else {
+				policy.catch_up = TickScheduler::CatchUp::Burst;
+				policy.max_burst = uint32_t(std::stoul(value));
+			}
+			argi += 1;
+		} else if ((arg == "--workers" || arg == "--room-size" || arg == "--spin-us" || arg == "--interest-budget") && argi + 1 < argc) {
+			uint32_t value = uint32_t(std::stoul(argv[argi + 1]));
+			if (arg == "--workers") workers = value;
+			else if (arg == "--room-size") room_size = value;
+			else if (arg == "--interest-budget") interest.budget = value;
+			else policy.spin = std::chrono::microseconds(value);
+			argi += 1;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	if (room_size == 0) {
+		usage();
 		return 1;
 	}
 
 	//------------ initialization ------------
 
-	Server server(argv[1]);
-
-	//------------ main loop ------------
+	Server server(port, transport);
+	server.netsim = netsim;
+	if (netsim.enabled()) std::cout << "Simulating network conditions: " << netsim.to_string() << std::endl;
 
-	//keep track of which connection is controlling which player:
-	std::unordered_map< Connection *, Player * > connection_to_player;
-	//keep track of game state:
-	Game game;
+	//each match runs in its own room; rooms tick on worker threads:
+	RoomManager rooms(workers, room_size, policy, interest, [&server](){ server.wake(); });
+	std::cout << "Running rooms of up to " << rooms.room_size << " players on " << rooms.workers.size() << " worker threads"
+	          << (interest.enabled ? ", with interest management." : ".") << std::endl;
 
-	while (true) {
-		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(Game::Tick);
-		//process incoming data from clients until a tick has elapsed:
-		while (true) {
-			auto now = std::chrono::steady_clock::now();
-			double remain = std::chrono::duration< double >(next_tick - now).count();
-			if (remain < 0.0) {
-				next_tick += std::chrono::duration< double >(Game::Tick);
-				break;
-			}
-
-			//helper used on client close (due to quit) and server close (due to error):
-			auto remove_connection = [&](Connection *c) {
-				auto f = connection_to_player.find(c);
-				assert(f != connection_to_player.end());
-				game.remove_player(f->second);
-				connection_to_player.erase(f);
-			};
-
-			server.poll([&](Connection *c, Connection::Event evt){
-				if (evt == Connection::OnOpen) {
-					//client connected:
+	//------------ main loop ------------
 
-					//create some player info for them:
-					connection_to_player.emplace(c, game.spawn_player());
+	//keep track of which room each connection is in:
+	// (rooms know clients by serial number, since a closed Connection's address can be reused)
+	struct ClientInfo {
+		uint64_t serial = 0;
+		Room *room = nullptr;
+	};
+	std::unordered_map< Connection *, ClientInfo > clients;
+	std::unordered_map< uint64_t, Connection * > connection_of;
+	uint64_t next_serial = 1;
 
-				} else if (evt == Connection::OnClose) {
-					//client disconnected:
+	auto next_report = std::chrono::steady_clock::now() + std::chrono::seconds(ReportSeconds);
 
+	while (true) {
+		//helper used on client close (due to quit) and server close (due to error):
+		auto remove_connection = [&](Connection *c) {
+			auto f = clients.find(c);
+			assert(f != clients.end());
+			rooms.leave(f->second.serial, f->second.room);
+			connection_of.erase(f->second.serial);
+			clients.erase(f);
+		};
+
+		//wait for socket activity or for a room to queue state messages (but not past the next report):
+		// (the poll itself also stops early for simulated network delivery and datagram resends/keepalives)
+		double wait = std::min(PollSeconds, std::chrono::duration< double >(next_report - std::chrono::steady_clock::now()).count());
+		server.poll([&](Connection *c, Connection::Event evt){
+			if (evt == Connection::OnOpen) {
+				//client connected:
+
+				//put them in a room:
+				uint64_t serial = next_serial++;
+				clients.emplace(c, ClientInfo{ .serial = serial, .room = rooms.join(serial) });
+				connection_of.emplace(serial, c);
+
+			} else if (evt == Connection::OnClose) {
+				//client disconnected:
+
+				remove_connection(c);
+
+			} else { assert(evt == Connection::OnRecv);
+				//got data from client:
+				//std::cout << "current buffer:\n" << hex_dump(c->recv_buffer.data(), c->recv_buffer.size()); std::cout.flush(); //DEBUG
+
+				//look up in players list:
+				auto f = clients.find(c);
+				assert(f != clients.end());
+				ClientInfo &info = f->second;
+
+				//handle messages from client (straight into the room's inbox):
+				try {
+					Room &room = *info.room;
+					std::lock_guard< std::mutex > lock(room.inbox_mutex);
+					Room::Input &input = room.inputs[info.serial];
+					bool handled_message;
+					do {
+						handled_message = false;
+						if (input.controls.recv_controls_message(c, &input.controls_sequence)) {
+							input.has_controls = true;
+							handled_message = true;
+						}
+						if (input.ack.recv_ack_message(c)) {
+							input.has_ack = true;
+							handled_message = true;
+						}
+						//TODO: extend for more message types as needed
+					} while (handled_message);
+				} catch (std::exception const &e) {
+					std::cout << "Disconnecting client:" << e.what() << std::endl;
+					c->close();
 					remove_connection(c);
-
-				} else { assert(evt == Connection::OnRecv);
-					//got data from client:
-					//std::cout << "current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
-
-					//look up in players list:
-					auto f = connection_to_player.find(c);
-					assert(f != connection_to_player.end());
-					Player &player = *f->second;
-
-					//handle messages from client:
-					try {
-						bool handled_message;
-						do {
-							handled_message = false;
-							if (player.controls.recv_controls_message(c)) handled_message = true;
-							//TODO: extend for more message types as needed
-						} while (handled_message);
-					} catch (std::exception const &e) {
-						std::cout << "Disconnecting client:" << e.what() << std::endl;
-						c->close();
-						remove_connection(c);
-					}
 				}
-			}, remain);
-		}
-
-		//update current game state
-		game.update(Game::Tick);
-
-		//send updated game state to all clients
-		for (auto &[c, player] : connection_to_player) {
-			game.send_state_message(c, player);
+			}
+		}, std::max(0.0, wait));
+
+		//send state messages from rooms that have ticked:
+		rooms.deliver([&](Room::Outgoing const &out) {
+			auto f = connection_of.find(out.client);
+			if (f == connection_of.end()) return; //(client left after the room ticked)
+			Game::send_state_message(f->second, out.player_id, out.controls_sequence, out.controls_ticks, out.state);
+		});
+		rooms.collect_closed();
+
+		auto now = std::chrono::steady_clock::now();
+		if (now >= next_report) {
+			next_report = now + std::chrono::seconds(ReportSeconds);
+			if (!rooms.rooms.empty()) rooms.report(std::cout);
 		}
-
 	}
 
 
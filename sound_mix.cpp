@@ -0,0 +1,272 @@
+#include "sound_mix.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MIX_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define MIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+//functions using instructions beyond the compiler's baseline (GCC/clang need to be told; MSVC allows them anywhere):
+#if defined(MIX_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MIX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MIX_TARGET_AVX2
+#endif
+
+char const *mix_kernel_name(MixKernel kernel) {
+	switch (kernel) {
+		case MixKernel::Scalar: return "scalar";
+		case MixKernel::SSE: return "sse";
+		case MixKernel::AVX2: return "avx2";
+		case MixKernel::NEON: return "neon";
+	}
+	return "unknown";
+}
+
+bool mix_kernel_supported(MixKernel kernel) {
+	switch (kernel) {
+		case MixKernel::Scalar: return true;
+#ifdef MIX_X86
+		case MixKernel::SSE: return true;
+		case MixKernel::AVX2: {
+	#ifdef _MSC_VER
+			//(AVX2 is leaf 7, EBX bit 5; and the OS must save the AVX registers: OSXSAVE, then XCR0 bits 1 and 2)
+			int info[4];
+			__cpuid(info, 1);
+			if (!(info[2] & (1 << 27))) return false;
+			if ((_xgetbv(0) & 0x6) != 0x6) return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+	#else
+			return __builtin_cpu_supports("avx2");
+	#endif
+		}
+#endif
+#ifdef MIX_NEON
+		case MixKernel::NEON: return true;
+#endif
+		default: return false;
+	}
+}
+
+MixKernel best_mix_kernel() {
+	for (MixKernel kernel : { MixKernel::AVX2, MixKernel::SSE, MixKernel::NEON }) {
+		if (mix_kernel_supported(kernel)) return kernel;
+	}
+	return MixKernel::Scalar;
+}
+
+//------------------------ kernels --------------------------------
+
+static void mix_scalar(float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step) {
+	for (uint32_t k = 0; k < count; ++k) {
+		out[2*k+0] += left * in[k];
+		out[2*k+1] += right * in[k];
+		left += left_step;
+		right += right_step;
+	}
+}
+
+#ifdef MIX_X86
+static void mix_sse(float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step) {
+	//gains for the four samples in flight, and how much they move every four samples:
+	__m128 l = _mm_add_ps(_mm_set1_ps(left), _mm_mul_ps(_mm_set1_ps(left_step), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+	__m128 r = _mm_add_ps(_mm_set1_ps(right), _mm_mul_ps(_mm_set1_ps(right_step), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+	__m128 l_step = _mm_set1_ps(4.0f * left_step);
+	__m128 r_step = _mm_set1_ps(4.0f * right_step);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 samples = _mm_loadu_ps(in + k);
+		__m128 ls = _mm_mul_ps(l, samples);
+		__m128 rs = _mm_mul_ps(r, samples);
+		//interleave back into L R L R:
+		__m128 lo = _mm_unpacklo_ps(ls, rs);
+		__m128 hi = _mm_unpackhi_ps(ls, rs);
+		_mm_storeu_ps(out + 2*k + 0, _mm_add_ps(_mm_loadu_ps(out + 2*k + 0), lo));
+		_mm_storeu_ps(out + 2*k + 4, _mm_add_ps(_mm_loadu_ps(out + 2*k + 4), hi));
+		l = _mm_add_ps(l, l_step);
+		r = _mm_add_ps(r, r_step);
+	}
+	//(leftover samples)
+	mix_scalar(out + 2*k, in + k, count - k, _mm_cvtss_f32(l), _mm_cvtss_f32(r), left_step, right_step);
+}
+
+MIX_TARGET_AVX2 static void mix_avx2(float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step) {
+	__m256 iota = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	__m256 l = _mm256_add_ps(_mm256_set1_ps(left), _mm256_mul_ps(_mm256_set1_ps(left_step), iota));
+	__m256 r = _mm256_add_ps(_mm256_set1_ps(right), _mm256_mul_ps(_mm256_set1_ps(right_step), iota));
+	__m256 l_step = _mm256_set1_ps(8.0f * left_step);
+	__m256 r_step = _mm256_set1_ps(8.0f * right_step);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 samples = _mm256_loadu_ps(in + k);
+		__m256 ls = _mm256_mul_ps(l, samples);
+		__m256 rs = _mm256_mul_ps(r, samples);
+		//unpack works within 128-bit halves: lo = L0 R0 L1 R1 | L4 R4 L5 R5, hi = L2 R2 L3 R3 | L6 R6 L7 R7
+		__m256 lo = _mm256_unpacklo_ps(ls, rs);
+		__m256 hi = _mm256_unpackhi_ps(ls, rs);
+		__m256 first = _mm256_permute2f128_ps(lo, hi, 0x20); //L0 R0 .. L3 R3
+		__m256 second = _mm256_permute2f128_ps(lo, hi, 0x31); //L4 R4 .. L7 R7
+		_mm256_storeu_ps(out + 2*k + 0, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 0), first));
+		_mm256_storeu_ps(out + 2*k + 8, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 8), second));
+		l = _mm256_add_ps(l, l_step);
+		r = _mm256_add_ps(r, r_step);
+	}
+	mix_scalar(out + 2*k, in + k, count - k, _mm256_cvtss_f32(l), _mm256_cvtss_f32(r), left_step, right_step);
+}
+#endif
+
+#ifdef MIX_NEON
+static void mix_neon(float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step) {
+	float const iota_values[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float32x4_t iota = vld1q_f32(iota_values);
+	float32x4_t l = vmlaq_n_f32(vdupq_n_f32(left), iota, left_step);
+	float32x4_t r = vmlaq_n_f32(vdupq_n_f32(right), iota, right_step);
+	float32x4_t l_step = vdupq_n_f32(4.0f * left_step);
+	float32x4_t r_step = vdupq_n_f32(4.0f * right_step);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		float32x4_t samples = vld1q_f32(in + k);
+		//(vld2/vst2 de-interleave and re-interleave L R L R)
+		float32x4x2_t mixed = vld2q_f32(out + 2*k);
+		mixed.val[0] = vmlaq_f32(mixed.val[0], l, samples);
+		mixed.val[1] = vmlaq_f32(mixed.val[1], r, samples);
+		vst2q_f32(out + 2*k, mixed);
+		l = vaddq_f32(l, l_step);
+		r = vaddq_f32(r, r_step);
+	}
+	mix_scalar(out + 2*k, in + k, count - k, vgetq_lane_f32(l, 0), vgetq_lane_f32(r, 0), left_step, right_step);
+}
+#endif
+
+void mix_mono_to_stereo(MixKernel kernel, float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step) {
+	assert(mix_kernel_supported(kernel));
+	switch (kernel) {
+#ifdef MIX_X86
+		case MixKernel::SSE: mix_sse(out, in, count, left, right, left_step, right_step); return;
+		case MixKernel::AVX2: mix_avx2(out, in, count, left, right, left_step, right_step); return;
+#endif
+#ifdef MIX_NEON
+		case MixKernel::NEON: mix_neon(out, in, count, left, right, left_step, right_step); return;
+#endif
+		default: mix_scalar(out, in, count, left, right, left_step, right_step); return;
+	}
+}
+
+//------------------------ 16-bit samples --------------------------------
+
+void pcm16_to_float(float *out, int16_t const *in, uint32_t count) {
+	constexpr float Scale = 1.0f / 32768.0f;
+	uint32_t k = 0;
+#if defined(MIX_X86)
+	//(SSE2, which every x86-64 CPU has; 8 samples at a time)
+	__m128 scale = _mm_set1_ps(Scale);
+	for (; k + 8 <= count; k += 8) {
+		__m128i samples = _mm_loadu_si128(reinterpret_cast< __m128i const * >(in + k));
+		//sign-extend to 32 bits by putting each sample in the high half of a lane and shifting down:
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(out + k + 0, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + k + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#elif defined(MIX_NEON)
+	for (; k + 8 <= count; k += 8) {
+		int16x8_t samples = vld1q_s16(in + k);
+		vst1q_f32(out + k + 0, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), Scale));
+		vst1q_f32(out + k + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), Scale));
+	}
+#endif
+	//(leftover samples, or all of them on other platforms)
+	for (; k < count; ++k) {
+		out[k] = float(in[k]) * Scale;
+	}
+}
+
+int16_t float_to_pcm16(float value) {
+	float scaled = std::round(value * 32768.0f);
+	return int16_t(std::max(-32768.0f, std::min(32767.0f, scaled)));
+}
+
+//------------------------ panning --------------------------------
+
+//sin(pi/2 x) for x in [0,1], as an odd polynomial (a minimax fit; max error 6e-7):
+static inline float sin_quarter_turn(float x) {
+	float x2 = x * x;
+	return x * (1.5707910f + x2 * (-0.64589286f + x2 * (0.079434350f + x2 * -0.0043330989f)));
+}
+
+void pan_weights(float pan, float *left, float *right) {
+	//clamp pan to -1 to 1 range:
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+
+	//x goes from 0 (most left) to 1 (most right); cos(pi/2 x) = sin(pi/2 (1 - x)):
+	float x = 0.5f * (pan + 1.0f);
+	*left = sin_quarter_turn(1.0f - x);
+	*right = sin_quarter_turn(x);
+}
+
+void pan_weights_3D(glm::vec3 const &listener_position, glm::vec3 const &listener_right,
+	glm::vec3 const &source_position, float source_half_radius, float *left, float *right) {
+	glm::vec3 to = source_position - listener_position;
+	float distance = glm::length(to);
+	if (distance == 0.0f) {
+		*left = *right = std::sqrt(2.0f);
+	} else {
+		//amt ranges from -1 (most left) to 1 (most right):
+		pan_weights(glm::dot(listener_right, to) / distance, left, right);
+
+		//want att = 0.5f at distance == half_volume_radius (no trig here, so this is the same as the exact version):
+		float att = 1.0f / (1.0f + (distance / source_half_radius));
+		*left *= att;
+		*right *= att;
+	}
+}
+
+void pan_weights_exact(float pan, float *left, float *right) {
+	//clamp pan to -1 to 1 range:
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+
+	//want left^2 + right^2 = 1.0, so use angles:
+	float ang = 0.5f * 3.1415926f * (0.5f * (pan + 1.0f));
+	*left = std::cos(ang);
+	*right = std::sin(ang);
+}
+
+void pan_weights_3D_exact(glm::vec3 const &listener_position, glm::vec3 const &listener_right,
+	glm::vec3 const &source_position, float source_half_radius, float *left, float *right) {
+	glm::vec3 to = source_position - listener_position;
+	float distance = glm::length(to);
+	//start by panning based on direction.
+	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
+	if (distance == 0.0f) {
+		*left = *right = std::sqrt(2.0f);
+	} else {
+		//amt ranges from -1 (most left) to 1 (most right):
+		float amt = glm::dot(listener_right, to) / distance;
+		//turn into an angle from 0.0f (most left) to pi/2 (most right):
+		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
+		*left = std::cos(ang);
+		*right = std::sin(ang);
+
+		//squared distance attenuation is realistic if there are no walls,
+		// but I'm going to use linear because it's sounds better to me.
+		// (feel free to change it, of course)
+		//want att = 0.5f at distance == half_volume_radius
+		float att = 1.0f / (1.0f + (distance / source_half_radius));
+		*left *= att;
+		*right *= att;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+//Inner loops of the audio mixer, and the panning it computes for every voice
+// (used by Sound.cpp's mix_block; no SDL, so benchmarks can use them directly).
+//
+//Mixing a voice adds its mono samples into the interleaved stereo output, scaled by left/right gains that
+// ramp linearly across the block (so pan and volume changes don't click):
+//   out[2k]   += (left  + k * left_step)  * in[k]
+//   out[2k+1] += (right + k * right_step) * in[k]
+//There are several implementations of this loop; they agree to within float rounding (the gain ramps
+// are stepped per lane, so they round a little differently than the one-sample-at-a-time scalar loop).
+
+enum class MixKernel : uint8_t {
+	Scalar, //one sample at a time (any platform)
+	SSE, //4 samples at a time (x86; SSE2 is always there on x86-64)
+	AVX2, //8 samples at a time (x86, if the CPU supports it; checked at run time)
+	NEON, //4 samples at a time (ARM)
+};
+
+char const *mix_kernel_name(MixKernel kernel);
+
+//can 'kernel' run on this machine?
+bool mix_kernel_supported(MixKernel kernel);
+
+//fastest kernel that can run on this machine:
+MixKernel best_mix_kernel();
+
+//add 'count' samples of 'in' into the interleaved stereo 'out' (2 * count floats) with ramped gains (see above):
+void mix_mono_to_stereo(MixKernel kernel, float *out, float const *in, uint32_t count, float left, float right, float left_step, float right_step);
+
+//---- 16-bit samples ----
+//(as stored by Sound::Sample::Format::PCM16; full scale is 32768, the same as SDL's conversions)
+
+//convert 'count' 16-bit samples to float:
+void pcm16_to_float(float *out, int16_t const *in, uint32_t count);
+//convert one float sample to 16 bits (rounding, and clamping to the 16-bit range):
+int16_t float_to_pcm16(float value);
+
+//---- panning ----
+//Equal-power panning: left = cos(angle), right = sin(angle), with the angle going from 0 (pan = -1, hard left)
+// to pi/2 (pan = 1, hard right), so left^2 + right^2 = 1 and a sound moving across keeps the same loudness.
+//The mixer computes these twice per voice per block, so they use a polynomial for sin(pi/2 x) instead of
+// std::cos / std::sin; it is within 1e-6 of the trig version (bench-mix measures both).
+
+//2D panning ('pan' is clamped to [-1,1]):
+void pan_weights(float pan, float *left, float *right);
+
+//3D panning: pan by the direction to 'source_position' along 'listener_right' (a unit vector),
+// then attenuate with distance, to half volume at 'source_half_radius' (which may be infinite):
+void pan_weights_3D(glm::vec3 const &listener_position, glm::vec3 const &listener_right,
+	glm::vec3 const &source_position, float source_half_radius, float *left, float *right);
+
+//the same, computed with std::cos / std::sin (for comparison):
+void pan_weights_exact(float pan, float *left, float *right);
+void pan_weights_3D_exact(glm::vec3 const &listener_position, glm::vec3 const &listener_right,
+	glm::vec3 const &source_position, float source_half_radius, float *left, float *right);